@@ -8,6 +8,54 @@
 #include <map>
 #include <algorithm>
 #include <string>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <atomic>
+#include <fcntl.h>
+#include <errno.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define USE_SHARED_FRAMES
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef _WIN32
+// Only the timer resolution calls are needed, windows.h would clash with names used here
+#pragma comment(lib, "winmm.lib")
+extern "C" __declspec(dllimport) unsigned int __stdcall timeBeginPeriod(unsigned int uPeriod);
+extern "C" __declspec(dllimport) unsigned int __stdcall timeEndPeriod(unsigned int uPeriod);
+
+// Layout of PROCESS_MEMORY_COUNTERS
+struct ProcessMemoryCounters
+{
+	unsigned long cb;
+	unsigned long PageFaultCount;
+	size_t PeakWorkingSetSize;
+	size_t WorkingSetSize;
+	size_t QuotaPeakPagedPoolUsage;
+	size_t QuotaPagedPoolUsage;
+	size_t QuotaPeakNonPagedPoolUsage;
+	size_t QuotaNonPagedPoolUsage;
+	size_t PagefileUsage;
+	size_t PeakPagefileUsage;
+};
+extern "C" __declspec(dllimport) void* __stdcall GetCurrentProcess();
+extern "C" __declspec(dllimport) int __stdcall K32GetProcessMemoryInfo(void* Process, ProcessMemoryCounters* Counters, unsigned long Size);
+#endif
 
 
 //
@@ -25,6 +73,24 @@
 
 #define PI 3.14159265
 
+// Seconds on a monotonic clock, shared by all timing code
+static double NowSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static FILE* OpenFile(const char* Path, const char* Mode)
+{
+#ifdef _MSC_VER
+	FILE* file = nullptr;
+	if (fopen_s(&file, Path, Mode) != 0)
+		return nullptr;
+	return file;
+#else
+	return fopen(Path, Mode);
+#endif
+}
+
 // 2d Vector with some needed overloads
 struct Vec2 
 {
@@ -63,6 +129,88 @@ struct Vec2
 
 };
 
+// Shortest difference on a torus of the given size, each component ends up in [-size/2, size/2)
+static Vec2 WrapDelta(const Vec2& Delta, const Vec2& World)
+{
+	return Vec2(Delta.x - World.x * floorf(Delta.x / World.x + 0.5f), Delta.y - World.y * floorf(Delta.y / World.y + 0.5f));
+}
+
+// Outlines known to the game, objects refer to them by id
+enum ModelId : uint8_t
+{
+	MODEL_POINT,
+	MODEL_SHUTTLE,
+	MODEL_ASTEROID,
+	MODEL_BULLET,
+	MODEL_COUNT
+};
+
+// Immutable unit-size outlines shared by all objects (flyweight).
+// Models drawn in large numbers also get their outline pre-rotated for every
+// quantized angle, so placing them is a table lookup, a scale and a translation.
+class ModelRegistry
+{
+public:
+	static const int AngleSteps = 256;
+
+private:
+	std::vector<Vec2> m_Models[MODEL_COUNT];
+	std::vector<Vec2> m_Rotated[MODEL_COUNT]; // AngleSteps rows of vertices, empty if not precomputed
+
+	ModelRegistry()
+	{
+		m_Models[MODEL_POINT] = { Vec2(0.0f, 0.0f) };
+		m_Models[MODEL_SHUTTLE] = { Vec2(-1.0f, 1.0f), Vec2(0.0f, -1.0f), Vec2(1.0f, 1.0f) };
+		// Rectangles
+		m_Models[MODEL_ASTEROID] = { Vec2(-1.0f, -1.0f), Vec2(-1.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, -1.0f) };
+		m_Models[MODEL_BULLET] = { Vec2(-1.0f, -1.0f), Vec2(-1.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, -1.0f) };
+
+		// The player turns smoothly and is alone, so only the crowd gets tables
+		PrecomputeRotations(MODEL_ASTEROID);
+		PrecomputeRotations(MODEL_BULLET);
+	}
+
+public:
+	static const ModelRegistry& Get()
+	{
+		static const ModelRegistry registry;
+		return registry;
+	}
+
+	const std::vector<Vec2>& GetModel(ModelId Id) const
+	{
+		return m_Models[Id];
+	}
+
+	// Outline rotated by the nearest table angle (degrees), nullptr if the model has no table
+	const Vec2* GetRotated(ModelId Id, float Angle) const
+	{
+		if (m_Rotated[Id].empty())
+			return nullptr;
+
+		int step = int(floorf(Angle * (AngleSteps / 360.0f) + 0.5f)) & (AngleSteps - 1);
+		return m_Rotated[Id].data() + step * m_Models[Id].size();
+	}
+
+private:
+	void PrecomputeRotations(ModelId Id)
+	{
+		const std::vector<Vec2>& model = m_Models[Id];
+		m_Rotated[Id].resize(AngleSteps * model.size());
+
+		for (int step = 0; step < AngleSteps; step++)
+		{
+			float angle = float(step * 2 * PI / AngleSteps);
+			float CosF = cosf(angle);
+			float SinF = sinf(angle);
+			for (size_t i = 0; i < model.size(); i++)
+			{
+				m_Rotated[Id][step * model.size() + i] = Vec2(model[i].x * CosF - model[i].y * SinF, model[i].x * SinF + model[i].y * CosF);
+			}
+		}
+	}
+};
+
 // Simple object with parameters for 2d movement
 class Flying_Object
 {
@@ -71,15 +219,15 @@ protected:
 	Vec2 m_Speed;
 	int m_Size;
 	float m_Angle;
-	std::vector<Vec2> m_Model;
+	ModelId m_Model;
 
 public: 
-	Flying_Object(const Vec2& Pos, const Vec2& Speed, const int Size, const float Angle, const std::vector<Vec2>& Model) :
+	Flying_Object(const Vec2& Pos, const Vec2& Speed, const int Size, const float Angle, const ModelId Model) :
 		m_Pos(Pos), m_Speed(Speed), m_Size(Size), m_Angle(Angle), m_Model(Model) {}
 
-	Flying_Object() : m_Pos(Vec2()), m_Speed(Vec2()), m_Size(1), m_Angle(0.0f), m_Model({ Vec2(0.0f, 0.0f) }) {}
+	Flying_Object() : m_Pos(Vec2()), m_Speed(Vec2()), m_Size(1), m_Angle(0.0f), m_Model(MODEL_POINT) {}
 
-	Flying_Object(const Vec2& Pos, const Vec2& Speed, const int Size, const float Angle) : m_Pos(Pos), m_Speed(Speed), m_Size(Size), m_Angle(Angle), m_Model({ Vec2(0.0f, 0.0f) }) {}
+	Flying_Object(const Vec2& Pos, const Vec2& Speed, const int Size, const float Angle) : m_Pos(Pos), m_Speed(Speed), m_Size(Size), m_Angle(Angle), m_Model(MODEL_POINT) {}
 
 	const Vec2 GetPosition() const
 	{
@@ -124,10 +272,15 @@ public:
 		return newPos;
 	}
 
-	std::vector<Vec2> GetModel()
+	ModelId GetModelId() const
 	{
 		return m_Model;
 	}
+
+	const std::vector<Vec2>& GetModel() const
+	{
+		return ModelRegistry::Get().GetModel(m_Model);
+	}
 };
 
 // Flying object with ability to limit speed and change it using acceletarion
@@ -141,7 +294,7 @@ public:
 	Shuttle() : Flying_Object(), m_Acceleration(50.0f), m_SpeedLimit(200) {}
 
 	Shuttle(const Vec2& Pos, const Vec2& Speed, const int Size, const float Angle, const float Acceleration):
-		Flying_Object(Pos, Speed, Size, Angle, { Vec2(-1.0f, 1.0f), Vec2(0.0f, -1.0f), Vec2(1.0f, 1.0f) }), m_Acceleration(Acceleration), m_SpeedLimit(100) {}
+		Flying_Object(Pos, Speed, Size, Angle, MODEL_SHUTTLE), m_Acceleration(Acceleration), m_SpeedLimit(100) {}
 
 	void SetAcceleration(const float Acceleration)
 	{
@@ -169,78 +322,551 @@ public:
 	}
 };
 
-
-class Gamefield
+// Purely visual particles (explosions, thruster exhaust). Nothing in the game logic reads them.
+// Storage is SoA in a fixed-capacity ring: when full, the oldest slots are recycled.
+// Integration and splatting work on 4 particles at a time with SSE2 when available.
+class ParticleSystem
 {
 public:
-	uint32_t const m_Obstacle_Color = 0xFF0000FF;
-	uint32_t const m_Player_Color = 0x0000FFFF;
-	uint32_t const m_Invincibility_Color = 0xFFFF00FF;
-	uint32_t const m_Bullet_Color = 0x00FF00FF;
-	uint32_t const m_Text_Color = 0x0FFFF0FF;
+	static const int Capacity = 1 << 17; // power of two, multiple of 4
 
 private:
-	uint32_t* const m_Board;
-	std::map<char, std::vector<Vec2>> PixelNumbers = { {'0', { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 2.0f), Vec2(0.0f, 2.0f), Vec2(0.0f, 0.0f) } },
-													   {'1', { Vec2(1.0f, 0.0f), Vec2(1.0f, 2.0f) } },
-													   {'2', { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 1.0f), Vec2(0.0f, 2.0f), Vec2(1.0f, 2.0f) } },
-													   {'3', { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 1.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, 2.0f), Vec2(0.0f, 2.0f) } },
-													   {'4', { Vec2(0.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 2.0f) } },
-													   {'5', { Vec2(1.0f, 0.0f), Vec2(0.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, 2.0f), Vec2(0.0f, 2.0f) } },
-													   {'6', { Vec2(0.0f, 0.0f), Vec2(0.0f, 2.0f), Vec2(1.0f, 2.0f), Vec2(1.0f, 1.0f), Vec2(0.0f, 1.0f) } },
-													   {'7', { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(0.0f, 2.0f) } },
-													   {'8', { Vec2(0.0f, 0.0f), Vec2(0.0f, 2.0f), Vec2(1.0f, 2.0f), Vec2(1.0f, 0.0f), Vec2(0.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f) } },
-													   {'9', { Vec2(0.0f, 2.0f), Vec2(1.0f, 2.0f), Vec2(1.0f, 0.0f), Vec2(0.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f) } } };
+	std::vector<float> m_X;
+	std::vector<float> m_Y;
+	std::vector<float> m_VX;
+	std::vector<float> m_VY;
+	std::vector<float> m_Life;
+	std::vector<float> m_InvLifeSpan;
+	std::vector<uint32_t> m_Color;
+
+	int m_Head;   // next slot to be written
+	int m_Tail;   // oldest slot that may still be alive, everything outside [m_Tail, m_Head) is dead
+	int m_Count;  // slots in [m_Tail, m_Head), Capacity when the ring is full
+	float m_Drag; // velocity fraction lost per second
+	uint32_t m_Seed;
 
 public:
-	Gamefield(uint32_t* board) : m_Board(board)
-	{}
+	ParticleSystem() :
+		m_X(Capacity), m_Y(Capacity), m_VX(Capacity), m_VY(Capacity), m_Life(Capacity), m_InvLifeSpan(Capacity), m_Color(Capacity),
+		m_Head(0), m_Tail(0), m_Count(0), m_Drag(1.5f), m_Seed(0x9E3779B9u) {}
 
-	void DrawText(std::string Text, const Vec2& offset) 
+	// Spawn particles flying in random directions inside [Angle - Spread, Angle + Spread] (degrees, 0 is up)
+	void Emit(const Vec2& Pos, const Vec2& BaseSpeed, int Count, float Angle, float Spread, float MinSpeed, float MaxSpeed, float LifeSpan, uint32_t Color)
 	{
-		// Draw text based on known set of lines
-		Vec2 step_offset = Vec2(15.0f, 0.0f);
+		for (int i = 0; i < Count; i++)
+		{
+			float a = (Angle + Spread * (2.0f * Random() - 1.0f)) * float(PI) / 180.0f;
+			float v = MinSpeed + (MaxSpeed - MinSpeed) * Random();
+			float life = LifeSpan * (0.5f + 0.5f * Random());
+
+			int slot = m_Head;
+			m_X[slot] = Pos.x;
+			m_Y[slot] = Pos.y;
+			m_VX[slot] = BaseSpeed.x + sinf(a) * v;
+			m_VY[slot] = BaseSpeed.y - cosf(a) * v;
+			m_Life[slot] = life;
+			m_InvLifeSpan[slot] = 1.0f / life;
+			m_Color[slot] = Color;
+
+			// A full ring overwrites its oldest particle
+			m_Head = (m_Head + 1) & (Capacity - 1);
+			if (m_Count < Capacity)
+				m_Count++;
+			else
+				m_Tail = m_Head;
+		}
+	}
+
+	void Clear()
+	{
+		std::fill(m_Life.begin(), m_Life.end(), 0.0f);
+		m_Head = 0;
+		m_Tail = 0;
+		m_Count = 0;
+	}
+
+	// Slots every update and render walks, the live particles and dead ones not yet left behind
+	int GetCount() const
+	{
+		return m_Count;
+	}
+
+	// Move, age and wrap particles around the given field size
+	void Update(float dt, float Width, float Height)
+	{
+		int begin[2], end[2];
+		int ranges = GetLiveRanges(begin, end);
+		float damp = std::max(0.0f, 1.0f - m_Drag * dt);
+
+#ifdef USE_SSE2
+		const __m128 vdt = _mm_set1_ps(dt);
+		const __m128 vdamp = _mm_set1_ps(damp);
+		const __m128 vzero = _mm_setzero_ps();
+		const __m128 vw = _mm_set1_ps(Width);
+		const __m128 vh = _mm_set1_ps(Height);
+
+		for (int r = 0; r < ranges; r++)
+		for (int i = begin[r]; i < end[r]; i += 4)
+		{
+			__m128 life = _mm_loadu_ps(&m_Life[i]);
+			if (_mm_movemask_ps(_mm_cmpgt_ps(life, vzero)) == 0)
+				continue;
+
+			__m128 vx = _mm_mul_ps(_mm_loadu_ps(&m_VX[i]), vdamp);
+			__m128 vy = _mm_mul_ps(_mm_loadu_ps(&m_VY[i]), vdamp);
+			__m128 x = _mm_add_ps(_mm_loadu_ps(&m_X[i]), _mm_mul_ps(vx, vdt));
+			__m128 y = _mm_add_ps(_mm_loadu_ps(&m_Y[i]), _mm_mul_ps(vy, vdt));
+
+			// Branchless wrap: add size where below zero, subtract where past the edge
+			x = _mm_add_ps(x, _mm_and_ps(_mm_cmplt_ps(x, vzero), vw));
+			x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpge_ps(x, vw), vw));
+			y = _mm_add_ps(y, _mm_and_ps(_mm_cmplt_ps(y, vzero), vh));
+			y = _mm_sub_ps(y, _mm_and_ps(_mm_cmpge_ps(y, vh), vh));
+
+			_mm_storeu_ps(&m_X[i], x);
+			_mm_storeu_ps(&m_Y[i], y);
+			_mm_storeu_ps(&m_VX[i], vx);
+			_mm_storeu_ps(&m_VY[i], vy);
+			_mm_storeu_ps(&m_Life[i], _mm_sub_ps(life, vdt));
+		}
+#else
+		for (int r = 0; r < ranges; r++)
+		for (int i = begin[r]; i < end[r]; i++)
+		{
+			if (m_Life[i] <= 0.0f)
+				continue;
+
+			m_VX[i] *= damp;
+			m_VY[i] *= damp;
+			float x = m_X[i] + m_VX[i] * dt;
+			float y = m_Y[i] + m_VY[i] * dt;
+			if (x < 0) x += Width;
+			if (x >= Width) x -= Width;
+			if (y < 0) y += Height;
+			if (y >= Height) y -= Height;
+			m_X[i] = x;
+			m_Y[i] = y;
+			m_Life[i] -= dt;
+		}
+#endif
+
+		// Lifetimes differ, so a dead particle can sit behind a live one, the window only shrinks from its old end
+		while (m_Count > 0 && m_Life[m_Tail] <= 0.0f)
+		{
+			m_Tail = (m_Tail + 1) & (Capacity - 1);
+			m_Count--;
+		}
+	}
 
-		for (int i = 0; i < Text.length(); i++)
+	// Additive saturating splat of all live particles, brightness fades with remaining life.
+	// Origin is the field position of the top-left screen pixel, inside [0, Width) x [0, Height).
+	// Touched gets a 1 for every square tile of 1 << TileShift pixels a particle landed in.
+	void Render(uint32_t* Board, const Vec2& Origin, float Width, float Height, uint8_t* Touched, int TileShift) const
+	{
+		const int tilesX = SCREEN_WIDTH >> TileShift;
+
+		int begin[2], end[2];
+		int ranges = GetLiveRanges(begin, end);
+
+#ifdef USE_SSE2
+		const __m128 vzero = _mm_setzero_ps();
+		const __m128 vox = _mm_set1_ps(Origin.x);
+		const __m128 voy = _mm_set1_ps(Origin.y);
+		const __m128 vw = _mm_set1_ps(Width);
+		const __m128 vh = _mm_set1_ps(Height);
+		const __m128 vscreenw = _mm_set1_ps(float(SCREEN_WIDTH));
+		const __m128 vscreenh = _mm_set1_ps(float(SCREEN_HEIGHT));
+		const __m128 vmaxx = _mm_set1_ps(float(SCREEN_WIDTH - 1));
+		const __m128 vmaxy = _mm_set1_ps(float(SCREEN_HEIGHT - 1));
+		const __m128 vpitch = _mm_set1_ps(float(SCREEN_WIDTH));
+		const __m128 v256 = _mm_set1_ps(256.0f);
+
+		alignas(16) int32_t index[4];
+		alignas(16) int32_t weight[4];
+
+		for (int r = 0; r < ranges; r++)
+		for (int i = begin[r]; i < end[r]; i += 4)
 		{
-			std::vector<Vec2> OffsetModel = PixelNumbers[Text[i]];
-			for (int j = 0; j < OffsetModel.size(); j++)
+			__m128 life = _mm_loadu_ps(&m_Life[i]);
+			if (_mm_movemask_ps(_mm_cmpgt_ps(life, vzero)) == 0)
+				continue;
+
+			// Move into screen space, wrapping around the field, then drop what is off screen
+			__m128 x = _mm_sub_ps(_mm_loadu_ps(&m_X[i]), vox);
+			__m128 y = _mm_sub_ps(_mm_loadu_ps(&m_Y[i]), voy);
+			x = _mm_add_ps(x, _mm_and_ps(_mm_cmplt_ps(x, vzero), vw));
+			y = _mm_add_ps(y, _mm_and_ps(_mm_cmplt_ps(y, vzero), vh));
+			__m128 visible = _mm_and_ps(_mm_cmplt_ps(x, vscreenw), _mm_cmplt_ps(y, vscreenh));
+			int alive = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(life, vzero), visible));
+			if (alive == 0)
+				continue;
+
+			// Pixel index computed in float is exact: SCREEN_WIDTH * SCREEN_HEIGHT < 2^24
+			x = _mm_min_ps(_mm_max_ps(x, vzero), vmaxx);
+			y = _mm_min_ps(_mm_max_ps(y, vzero), vmaxy);
+			x = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+			y = _mm_cvtepi32_ps(_mm_cvttps_epi32(y));
+			_mm_store_si128((__m128i*)index, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(y, vpitch), x)));
+
+			__m128 fade = _mm_min_ps(_mm_mul_ps(life, _mm_loadu_ps(&m_InvLifeSpan[i])), _mm_set1_ps(1.0f));
+			_mm_store_si128((__m128i*)weight, _mm_cvttps_epi32(_mm_mul_ps(fade, v256)));
+
+			for (int j = 0; j < 4; j++)
 			{
-				OffsetModel[j] = OffsetModel[j] * 10;
-				OffsetModel[j] += step_offset * i + offset;
+				if (!(alive & (1 << j)))
+					continue;
+				Touched[(index[j] / SCREEN_WIDTH >> TileShift) * tilesX + (index[j] % SCREEN_WIDTH >> TileShift)] = 1;
+				uint32_t* pixel = Board + index[j];
+				__m128i sum = _mm_adds_epu8(_mm_cvtsi32_si128(int(*pixel)), _mm_cvtsi32_si128(int(ScaleColor(m_Color[i + j], weight[j]))));
+				*pixel = uint32_t(_mm_cvtsi128_si32(sum));
 			}
+		}
+#else
+		for (int r = 0; r < ranges; r++)
+		for (int i = begin[r]; i < end[r]; i++)
+		{
+			if (m_Life[i] <= 0.0f)
+				continue;
+
+			float fx = m_X[i] - Origin.x;
+			float fy = m_Y[i] - Origin.y;
+			if (fx < 0) fx += Width;
+			if (fy < 0) fy += Height;
+			if (fx >= SCREEN_WIDTH || fy >= SCREEN_HEIGHT)
+				continue;
+
+			int x = std::min(std::max(int(fx), 0), SCREEN_WIDTH - 1);
+			int y = std::min(std::max(int(fy), 0), SCREEN_HEIGHT - 1);
+			int weight = int(std::min(m_Life[i] * m_InvLifeSpan[i], 1.0f) * 256.0f);
+			Touched[(y >> TileShift) * tilesX + (x >> TileShift)] = 1;
+			uint32_t* pixel = Board + y * SCREEN_WIDTH + x;
+			*pixel = AddSaturate(*pixel, ScaleColor(m_Color[i], weight));
+		}
+#endif
+	}
+
+private:
+	// Slot ranges covering [m_Tail, m_Head), split where the ring wraps and widened to whole quads.
+	// Extra slots are dead, the loops skip or harmlessly age them.
+	int GetLiveRanges(int* Begin, int* End) const
+	{
+		if (m_Count == 0)
+			return 0;
+
+		int last = m_Tail + m_Count;
+		Begin[0] = m_Tail & ~3;
+		End[0] = std::min((last + 3) & ~3, int(Capacity));
+		if (last <= Capacity)
+			return 1;
+
+		// A full ring can share its first quad between both ranges
+		Begin[1] = 0;
+		End[1] = std::min(((last - Capacity) + 3) & ~3, Begin[0]);
+		return 2;
+	}
+
+	float Random()
+	{
+		// xorshift32, separate from rand() so effects never disturb the game's random sequence
+		m_Seed ^= m_Seed << 13;
+		m_Seed ^= m_Seed >> 17;
+		m_Seed ^= m_Seed << 5;
+		return float(m_Seed >> 8) / float(1 << 24);
+	}
+
+	static uint32_t ScaleColor(uint32_t Color, int Weight)
+	{
+		// Scale all 4 channels by Weight/256, two channels per multiply
+		uint32_t rb = ((Color & 0x00FF00FFu) * uint32_t(Weight) >> 8) & 0x00FF00FFu;
+		uint32_t ga = (((Color >> 8) & 0x00FF00FFu) * uint32_t(Weight)) & 0xFF00FF00u;
+		return rb | ga;
+	}
+
+	static uint32_t AddSaturate(uint32_t a, uint32_t b)
+	{
+		uint32_t result = 0;
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			uint32_t sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF);
+			result |= std::min(sum, 0xFFu) << shift;
+		}
+		return result;
+	}
+};
+
+
+// Painter's order between groups of commands, order inside a layer is up to the rasterizer
+enum DrawLayer : uint8_t
+{
+	LAYER_PLAYER,
+	LAYER_BULLETS,
+	LAYER_ASTEROIDS,
+	LAYER_HUD
+};
+
+enum DrawCommandType : uint8_t
+{
+	DRAW_LINES,   // open polyline
+	DRAW_POLYGON, // closed polyline
+	DRAW_TEXT     // glyph run, First/Count index the text pool
+};
+
+// One entry of the retained frame description, plain data so it can be written as is
+struct DrawCommand
+{
+	uint8_t Type;
+	uint8_t Layer;
+	int16_t Top;     // topmost row touched, used to sort for locality
+	uint32_t Color;
+	uint32_t First;
+	uint32_t Count;
+	uint32_t Hash;   // over what the rasterizer will actually see, for deduplication
+	Vec2 Origin;     // text only
+};
+
+// Frame recorded by GameManager as already transformed geometry, consumed by Gamefield::Execute
+class DrawCommandBuffer
+{
+private:
+	std::vector<DrawCommand> m_Commands;
+	std::vector<Vec2> m_Vertices;
+	std::vector<char> m_Text;
+	uint8_t m_Layer;
+
+	bool m_HasView;
+	Vec2 m_ViewCenter;
+	Vec2 m_World;
+
+	struct FileHeader
+	{
+		char Magic[4];
+		uint32_t Version;
+		uint32_t CommandCount;
+		uint32_t VertexCount;
+		uint32_t TextSize;
+	};
+
+public:
+	DrawCommandBuffer() : m_Layer(0), m_HasView(false) {}
+
+	void Clear()
+	{
+		m_Commands.clear();
+		m_Vertices.clear();
+		m_Text.clear();
+		m_Layer = 0;
+		m_HasView = false;
+	}
 
-			DrawFigure(OffsetModel, m_Text_Color);
+	// Record objects around a camera looking at Center of a wrapping world, objects off screen
+	// are dropped. Without a view, object positions are screen positions.
+	void SetView(const Vec2& Center, const Vec2& World)
+	{
+		m_HasView = true;
+		m_ViewCenter = Center;
+		m_World = World;
+	}
+
+	void SetLayer(uint8_t Layer)
+	{
+		m_Layer = Layer;
+	}
+
+	void PushFlyingObject(const Flying_Object& F_Obj, uint32_t Color)
+	{
+		Vec2 position = F_Obj.GetPosition();
+		float size = float(F_Obj.GetSize());
+		if (m_HasView)
+		{
+			position = WrapDelta(position - m_ViewCenter, m_World) + Vec2(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+
+			float reach = size * 1.5f;
+			if (position.x < -reach || position.y < -reach || position.x > SCREEN_WIDTH + reach || position.y > SCREEN_HEIGHT + reach)
+				return;
+		}
+
+		// Get set of dots, adjust their position, store as polygon
+		const std::vector<Vec2>& Model = F_Obj.GetModel();
+		const Vec2* Rotated = ModelRegistry::Get().GetRotated(F_Obj.GetModelId(), F_Obj.GetAngle());
+
+		uint32_t first = uint32_t(m_Vertices.size());
+		for (size_t i = 0; i < Model.size(); i++)
+		{
+			Vec2 vertex = Model[i];
+			if (Rotated)
+				vertex = Rotated[i] * size + position;
+			else
+				AdjustByDimensions(vertex, position, F_Obj.GetAngle(), F_Obj.GetSize());
+			m_Vertices.push_back(vertex);
 		}
+		FinishGeometry(DRAW_POLYGON, first, Color);
 	}
 
-	void DrawFlyingObjects(std::vector<Flying_Object>& F_Objs, uint32_t Color)
+	void PushFlyingObjects(const std::vector<Flying_Object>& F_Objs, uint32_t Color)
 	{
-		for (std::vector<Flying_Object>::iterator it = F_Objs.begin(); it != F_Objs.end(); ++it)
+		for (std::vector<Flying_Object>::const_iterator it = F_Objs.begin(); it != F_Objs.end(); ++it)
 		{
-			DrawFlyingObject(*it, Color);
+			PushFlyingObject(*it, Color);
 		}
 	}
 
-	void DrawFlyingObject(Flying_Object& F_Obj, uint32_t Color)
+	void PushText(const std::string& Text, const Vec2& Offset, uint32_t Color)
+	{
+		DrawCommand cmd;
+		cmd.Type = DRAW_TEXT;
+		cmd.Layer = m_Layer;
+		cmd.Top = int16_t(Offset.y);
+		cmd.Color = Color;
+		cmd.First = uint32_t(m_Text.size());
+		cmd.Count = uint32_t(Text.size());
+		cmd.Origin = Offset;
+
+		uint32_t hash = HashStart(cmd);
+		hash = HashBytes(hash, &Offset, sizeof(Offset));
+		hash = HashBytes(hash, Text.data(), Text.size());
+		cmd.Hash = hash;
+
+		m_Text.insert(m_Text.end(), Text.begin(), Text.end());
+		m_Commands.push_back(cmd);
+	}
+
+	size_t Size() const
+	{
+		return m_Commands.size();
+	}
+
+	const DrawCommand& GetCommand(size_t Index) const
+	{
+		return m_Commands[Index];
+	}
+
+	const Vec2* GetVertices(const DrawCommand& Cmd) const
+	{
+		return m_Vertices.data() + Cmd.First;
+	}
+
+	const char* GetText(const DrawCommand& Cmd) const
+	{
+		return m_Text.data() + Cmd.First;
+	}
+
+	// True if both commands would put exactly the same pixels on the board
+	bool IsSame(const DrawCommand& a, const DrawCommand& b) const
 	{
-		// Get set of dots, adjust their position, pass to draw
-		std::vector<Vec2> BoardModel = F_Obj.GetModel();
-		for (int i = 0; i < BoardModel.size(); i++)
+		if (a.Hash != b.Hash || a.Type != b.Type || a.Color != b.Color || a.Count != b.Count)
+			return false;
+
+		if (a.Type == DRAW_TEXT)
+			return a.Origin.x == b.Origin.x && a.Origin.y == b.Origin.y && memcmp(GetText(a), GetText(b), a.Count) == 0;
+
+		const Vec2* va = GetVertices(a);
+		const Vec2* vb = GetVertices(b);
+		for (uint32_t i = 0; i < a.Count; i++)
 		{
-			AdjustByDimensions(BoardModel[i], F_Obj.GetPosition(), F_Obj.GetAngle(), F_Obj.GetSize());
+			if (int(va[i].x) != int(vb[i].x) || int(va[i].y) != int(vb[i].y))
+				return false;
 		}
+		return true;
+	}
 
-		DrawPolygon(BoardModel, Color);
+	// Binary dump of the whole frame, so rendering can be replayed without the game
+	bool SaveToFile(const char* Path) const
+	{
+		FILE* file = OpenFile(Path, "wb");
+		if (!file)
+			return false;
+
+		FileHeader header = { { 'A', 'D', 'C', 'B' }, 1, uint32_t(m_Commands.size()), uint32_t(m_Vertices.size()), uint32_t(m_Text.size()) };
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		ok = ok && fwrite(m_Commands.data(), sizeof(DrawCommand), m_Commands.size(), file) == m_Commands.size();
+		ok = ok && fwrite(m_Vertices.data(), sizeof(Vec2), m_Vertices.size(), file) == m_Vertices.size();
+		ok = ok && fwrite(m_Text.data(), 1, m_Text.size(), file) == m_Text.size();
+
+		fclose(file);
+		return ok;
 	}
 
-	void Clear() 
+	bool LoadFromFile(const char* Path)
 	{
-		memset(buffer, 0, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
+		Clear();
+
+		FILE* file = OpenFile(Path, "rb");
+		if (!file)
+			return false;
+
+		FileHeader header;
+		bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.Magic, "ADCB", 4) == 0 && header.Version == 1;
+		if (ok)
+		{
+			m_Commands.resize(header.CommandCount);
+			m_Vertices.resize(header.VertexCount);
+			m_Text.resize(header.TextSize);
+			ok = fread(m_Commands.data(), sizeof(DrawCommand), m_Commands.size(), file) == m_Commands.size();
+			ok = ok && fread(m_Vertices.data(), sizeof(Vec2), m_Vertices.size(), file) == m_Vertices.size();
+			ok = ok && fread(m_Text.data(), 1, m_Text.size(), file) == m_Text.size();
+		}
+		fclose(file);
+
+		// Never trust ranges coming from disk
+		for (size_t i = 0; ok && i < m_Commands.size(); i++)
+		{
+			const DrawCommand& cmd = m_Commands[i];
+			size_t limit = cmd.Type == DRAW_TEXT ? m_Text.size() : m_Vertices.size();
+			ok = cmd.Type <= DRAW_TEXT && cmd.First <= limit && cmd.Count <= limit - cmd.First;
+		}
+
+		if (!ok)
+			Clear();
+		return ok;
 	}
 
 private:
-	void AdjustByDimensions(Vec2& vec, const Vec2& offset, float angle, int size)
+	void FinishGeometry(DrawCommandType Type, uint32_t First, uint32_t Color)
+	{
+		DrawCommand cmd;
+		cmd.Type = Type;
+		cmd.Layer = m_Layer;
+		cmd.Color = Color;
+		cmd.First = First;
+		cmd.Count = uint32_t(m_Vertices.size()) - First;
+		cmd.Origin = Vec2();
+
+		// Rasterizer works on truncated coordinates, so hash those
+		float top = float(SCREEN_HEIGHT);
+		uint32_t hash = HashStart(cmd);
+		for (size_t i = First; i < m_Vertices.size(); i++)
+		{
+			int xy[2] = { int(m_Vertices[i].x), int(m_Vertices[i].y) };
+			hash = HashBytes(hash, xy, sizeof(xy));
+			top = std::min(top, m_Vertices[i].y);
+		}
+		cmd.Top = int16_t(std::max(top, 0.0f));
+		cmd.Hash = hash;
+
+		m_Commands.push_back(cmd);
+	}
+
+	static uint32_t HashStart(const DrawCommand& Cmd)
+	{
+		uint32_t hash = 2166136261u;
+		hash = HashBytes(hash, &Cmd.Type, sizeof(Cmd.Type));
+		hash = HashBytes(hash, &Cmd.Color, sizeof(Cmd.Color));
+		return HashBytes(hash, &Cmd.Count, sizeof(Cmd.Count));
+	}
+
+	static uint32_t HashBytes(uint32_t Hash, const void* Data, size_t Size)
+	{
+		// FNV-1a
+		const unsigned char* bytes = (const unsigned char*)Data;
+		for (size_t i = 0; i < Size; i++)
+		{
+			Hash ^= bytes[i];
+			Hash *= 16777619u;
+		}
+		return Hash;
+	}
+
+	static void AdjustByDimensions(Vec2& vec, const Vec2& offset, float angle, int size)
 	{
 		// Basically matrix-vector multiplication + translation vector
 		float x = vec.x * size;
@@ -251,51 +877,86 @@ private:
 		vec.y = x * SinF + y * CosF;
 		vec += offset;
 	}
+};
 
-	void DrawFigure(const std::vector<Vec2>& Model, uint32_t Color)
-	{
-		// Connect set of dots
-		if (Model.size() <= 0)
-			return;
+class Gamefield
+{
+public:
+	uint32_t const m_Obstacle_Color = 0xFF0000FF;
+	uint32_t const m_Player_Color = 0x0000FFFF;
+	uint32_t const m_Invincibility_Color = 0xFFFF00FF;
+	uint32_t const m_Bullet_Color = 0x00FF00FF;
+	uint32_t const m_Text_Color = 0x0FFFF0FF;
+	uint32_t const m_Explosion_Color = 0x00FFA040;
+	uint32_t const m_Exhaust_Color = 0x004080FF;
 
-		if (Model.size() == 1)
-			DrawPoint(Model[0].x, Model[0].y, Color);
+	// Clip tiles are squares of 1 << ClipTileShift pixels
+	static const int ClipTileShift = 5;
+	static const int ClipTilesX = SCREEN_WIDTH >> ClipTileShift;
+	static const int ClipTilesY = SCREEN_HEIGHT >> ClipTileShift;
 
-		for (int i = 0; i < Model.size() - 1; i++)
-		{
-			DrawLine(Model[i].x, Model[i].y, Model[i + 1].x, Model[i + 1].y, Color);
-		}
-	}
+private:
+	uint32_t* m_Board;
+	bool m_Wrap;
+	const uint8_t* m_Clip;
 
-	void DrawPolygon(const std::vector<Vec2>& Model, uint32_t Color)
+	struct SortEntry
 	{
-		// Connect set of dots but last is connected to first if enough dots are present
-		if (Model.size() <= 0)
-			return;
-
-		if (Model.size() == 1)
-			DrawPoint(Model[0].x, Model[0].y, Color);
+		uint64_t Key;
+		uint32_t Hash;
+		uint32_t Index;
 
-		for (int i = 0; i < Model.size(); i++)
+		bool operator<(const SortEntry& other) const
 		{
-			if (i == Model.size() - 1)
-				DrawLine(Model[i].x, Model[i].y, Model[0].x, Model[0].y, Color);
-			else
-				DrawLine(Model[i].x, Model[i].y, Model[i + 1].x, Model[i + 1].y, Color);
+			if (Key != other.Key)
+				return Key < other.Key;
+			if (Hash != other.Hash)
+				return Hash < other.Hash;
+			return Index < other.Index;
 		}
+	};
+	std::vector<SortEntry> m_Order;
+	std::vector<Vec2> m_Glyph;
+
+	std::map<char, std::vector<Vec2>> PixelNumbers = { {'0', { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 2.0f), Vec2(0.0f, 2.0f), Vec2(0.0f, 0.0f) } },
+													   {'1', { Vec2(1.0f, 0.0f), Vec2(1.0f, 2.0f) } },
+													   {'2', { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 1.0f), Vec2(0.0f, 2.0f), Vec2(1.0f, 2.0f) } },
+													   {'3', { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 1.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, 2.0f), Vec2(0.0f, 2.0f) } },
+													   {'4', { Vec2(0.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, 0.0f), Vec2(1.0f, 2.0f) } },
+													   {'5', { Vec2(1.0f, 0.0f), Vec2(0.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, 2.0f), Vec2(0.0f, 2.0f) } },
+													   {'6', { Vec2(0.0f, 0.0f), Vec2(0.0f, 2.0f), Vec2(1.0f, 2.0f), Vec2(1.0f, 1.0f), Vec2(0.0f, 1.0f) } },
+													   {'7', { Vec2(0.0f, 0.0f), Vec2(1.0f, 0.0f), Vec2(0.0f, 2.0f) } },
+													   {'8', { Vec2(0.0f, 0.0f), Vec2(0.0f, 2.0f), Vec2(1.0f, 2.0f), Vec2(1.0f, 0.0f), Vec2(0.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f) } },
+													   {'9', { Vec2(0.0f, 2.0f), Vec2(1.0f, 2.0f), Vec2(1.0f, 0.0f), Vec2(0.0f, 0.0f), Vec2(0.0f, 1.0f), Vec2(1.0f, 1.0f) } } };
+
+public:
+	Gamefield(uint32_t* board) : m_Board(board), m_Wrap(true), m_Clip(nullptr)
+	{}
+
+	// Wrap lines around the screen edges (whole world on screen) or clip them (camera view)
+	void SetWrap(bool Wrap)
+	{
+		m_Wrap = Wrap;
 	}
 
-	void DrawLine(int x0, int y0, int x1, int y1, uint32_t Color)
+	bool GetWrap() const
+	{
+		return m_Wrap;
+	}
+
+	// Pixels of a line, handed to Plot(x, y) in unclipped board coordinates
+	template <typename Plot>
+	static void RasterLine(int x0, int y0, int x1, int y1, Plot plot)
 	{
 		// Naive calculation of line formula (y = kx + b) 
 		if (x0 == x1)
 		{
 			if (y1 >= y0)
 				for (int i = y0; i < y1; i++)
-					DrawPoint(x0, i, Color);
+					plot(x0, i);
 			else
 				for (int i = y0; i > y1; i--)
-					DrawPoint(x0, i, Color);
+					plot(x0, i);
 			return;
 		}
 
@@ -304,52 +965,1492 @@ private:
 		float last_y;
 		if (x1 > x0)
 		{
-			last_y = y0;
-			for (int i = x0; i < x1 + 1; i++)
+			last_y = y0;
+			for (int i = x0; i < x1 + 1; i++)
+			{
+				float y = round(k*i + b);
+				if (y > last_y)
+					for (float yy = last_y; yy < y + 1; yy++)
+						plot(i, int(yy));
+				else
+					for (float yy = y; yy < last_y + 1; yy++)
+						plot(i, int(yy));
+				last_y = y;
+			}
+		}
+
+		else
+		{
+			last_y = y1;
+			for (int i = x1; i < x0 + 1; i++)
+			{
+				float y = round(k*i + b);
+				if (y > last_y)
+					for (float yy = last_y; yy < y + 1; yy++)
+						plot(i, int(yy));
+				else
+					for (float yy = y; yy < last_y + 1; yy++)
+						plot(i, int(yy));
+				last_y = y;
+			}
+		}
+	}
+
+	// Same edges DrawPolygon would draw
+	template <typename Plot>
+	static void RasterPolygon(const Vec2* Model, int Count, Plot plot)
+	{
+		if (Count == 1)
+			plot(int(Model[0].x), int(Model[0].y));
+
+		for (int i = 0; i < Count; i++)
+		{
+			const Vec2& next = Model[i == Count - 1 ? 0 : i + 1];
+			RasterLine(int(Model[i].x), int(Model[i].y), int(next.x), int(next.y), plot);
+		}
+	}
+
+	void SetBoard(uint32_t* board)
+	{
+		m_Board = board;
+	}
+
+	// Only pixels in tiles with a non-zero entry get written, nullptr draws everywhere
+	void SetClip(const uint8_t* Tiles)
+	{
+		m_Clip = Tiles;
+	}
+
+	void Execute(const DrawCommandBuffer& Commands, int FirstLayer, int LastLayer)
+	{
+		Execute(Commands, FirstLayer, LastLayer, [](size_t) { return true; });
+	}
+
+	// Same as above for the commands Filter(index) accepts
+	template <typename Filter>
+	void Execute(const DrawCommandBuffer& Commands, int FirstLayer, int LastLayer, Filter filter)
+	{
+		// Layer first to keep the painter's order, then color and row to stay in cache,
+		// hash last so identical commands end up next to each other
+		m_Order.clear();
+		for (size_t i = 0; i < Commands.Size(); i++)
+		{
+			const DrawCommand& cmd = Commands.GetCommand(i);
+			if (cmd.Layer < FirstLayer || cmd.Layer > LastLayer || !filter(i))
+				continue;
+
+			SortEntry entry;
+			entry.Key = (uint64_t(cmd.Layer) << 56) | (uint64_t(cmd.Color) << 24) | (uint64_t(cmd.Type) << 16) | uint64_t(uint16_t(cmd.Top));
+			entry.Hash = cmd.Hash;
+			entry.Index = uint32_t(i);
+			m_Order.push_back(entry);
+		}
+		std::sort(m_Order.begin(), m_Order.end());
+
+		const DrawCommand* previous = nullptr;
+		for (size_t i = 0; i < m_Order.size(); i++)
+		{
+			const DrawCommand& cmd = Commands.GetCommand(m_Order[i].Index);
+			if (previous && Commands.IsSame(*previous, cmd))
+				continue;
+			previous = &cmd;
+
+			switch (cmd.Type)
+			{
+			case DRAW_LINES:
+				DrawFigure(Commands.GetVertices(cmd), cmd.Count, cmd.Color);
+				break;
+			case DRAW_POLYGON:
+				DrawPolygon(Commands.GetVertices(cmd), cmd.Count, cmd.Color);
+				break;
+			case DRAW_TEXT:
+				DrawText(Commands.GetText(cmd), cmd.Count, cmd.Origin, cmd.Color);
+				break;
+			}
+		}
+	}
+
+	// Touched marks the clip tiles that got particles
+	void DrawParticles(const ParticleSystem& Particles, const Vec2& Origin, const Vec2& World, uint8_t* Touched)
+	{
+		Particles.Render(m_Board, Origin, World.x, World.y, Touched, ClipTileShift);
+	}
+
+private:
+	void DrawText(const char* Text, int Length, const Vec2& offset, uint32_t Color)
+	{
+		// Draw text based on known set of lines
+		Vec2 step_offset = Vec2(15.0f, 0.0f);
+
+		for (int i = 0; i < Length; i++)
+		{
+			std::map<char, std::vector<Vec2>>::const_iterator glyph = PixelNumbers.find(Text[i]);
+			if (glyph == PixelNumbers.end())
+				continue;
+
+			m_Glyph = glyph->second;
+			for (int j = 0; j < m_Glyph.size(); j++)
+			{
+				m_Glyph[j] = m_Glyph[j] * 10;
+				m_Glyph[j] += step_offset * i + offset;
+			}
+
+			DrawFigure(m_Glyph.data(), int(m_Glyph.size()), Color);
+		}
+	}
+
+	void DrawFigure(const Vec2* Model, int Count, uint32_t Color)
+	{
+		// Connect set of dots
+		if (Count <= 0)
+			return;
+
+		if (Count == 1)
+			DrawPoint(Model[0].x, Model[0].y, Color);
+
+		for (int i = 0; i < Count - 1; i++)
+		{
+			DrawLine(Model[i].x, Model[i].y, Model[i + 1].x, Model[i + 1].y, Color);
+		}
+	}
+
+	void DrawPolygon(const Vec2* Model, int Count, uint32_t Color)
+	{
+		// Connect set of dots but last is connected to first if enough dots are present
+		if (Count <= 0)
+			return;
+
+		if (Count == 1)
+			DrawPoint(Model[0].x, Model[0].y, Color);
+
+		for (int i = 0; i < Count; i++)
+		{
+			if (i == Count - 1)
+				DrawLine(Model[i].x, Model[i].y, Model[0].x, Model[0].y, Color);
+			else
+				DrawLine(Model[i].x, Model[i].y, Model[i + 1].x, Model[i + 1].y, Color);
+		}
+	}
+
+	void DrawLine(int x0, int y0, int x1, int y1, uint32_t Color)
+	{
+		RasterLine(x0, y0, x1, y1, [&](int x, int y) { DrawPoint(x, y, Color); });
+	}
+
+	void DrawPoint(int x, int y, uint32_t Color)
+	{
+		if (!m_Wrap)
+		{
+			if (x >= 0 && y >= 0 && x < SCREEN_WIDTH && y < SCREEN_HEIGHT && !IsClipped(x, y))
+				*(m_Board + y * SCREEN_WIDTH + x) = Color;
+			return;
+		}
+
+		float fx, fy;
+		LoopCoordinates(x, y, fx, fy);
+		if (!IsClipped(int(fx), int(fy)))
+			*(m_Board + int(fy * SCREEN_WIDTH) + int(fx)) = Color;
+	}
+
+	bool IsClipped(int x, int y) const
+	{
+		return m_Clip && !m_Clip[(y >> ClipTileShift) * ClipTilesX + (x >> ClipTileShift)];
+	}
+
+	void LoopCoordinates(float in_x, float in_y, float& out_x, float& out_y)
+	{
+		out_x = in_x;
+		out_y = in_y;
+		if (in_x < 0) out_x = in_x + SCREEN_WIDTH;
+		if (in_x >= SCREEN_WIDTH) out_x = in_x - SCREEN_WIDTH;
+		if (in_y < 0) out_y = in_y + SCREEN_HEIGHT;
+		if (in_y >= SCREEN_HEIGHT) out_y = in_y - SCREEN_HEIGHT;
+	}
+};
+
+// Persistent layers a frame is composited from. The object layer is kept between frames: commands
+// that appeared or disappeared since the last frame mark the tiles they cover, only those tiles are
+// cleared and only commands touching them are rasterized again. The HUD layer is redrawn only when
+// its text changes. A frame is then a copy of the object layer, the particles and the HUD on top.
+// Every render target seen recently, the window buffer or each slot of a shared frame ring, keeps
+// the tiles where it differs from the object layer: objects changed since it was last written plus
+// wherever particles or the HUD were put on it. Only those tiles are copied into it.
+class FrameLayers
+{
+public:
+	static const size_t MaxTargets = 32; // window buffer and a full shared frame ring
+
+private:
+	// What a command puts on the board, commands with equal footprints draw the same pixels
+	struct Footprint
+	{
+		uint32_t Hash;
+		uint32_t Count;
+		int Left, Top, Right, Bottom; // inclusive, before wrapping or clipping
+		uint32_t Index;               // into the current DrawCommandBuffer
+
+		bool operator<(const Footprint& other) const
+		{
+			if (Hash != other.Hash)
+				return Hash < other.Hash;
+			if (Count != other.Count)
+				return Count < other.Count;
+			if (Left != other.Left)
+				return Left < other.Left;
+			if (Top != other.Top)
+				return Top < other.Top;
+			if (Right != other.Right)
+				return Right < other.Right;
+			return Bottom < other.Bottom;
+		}
+	};
+
+	std::vector<uint32_t> m_Objects;
+	std::vector<Footprint> m_Previous;
+	std::vector<Footprint> m_Current;
+	std::vector<uint8_t> m_Dirty;    // one entry per clip tile
+	std::vector<uint8_t> m_Selected; // one entry per command of the current frame
+	bool m_Valid;
+
+	struct TargetState
+	{
+		const uint32_t* Target;
+		std::vector<uint8_t> Stale; // tiles of Target that differ from the object layer
+	};
+	std::deque<TargetState> m_Targets; // most recently written last
+
+	std::vector<uint32_t> m_Hud;
+	std::vector<Footprint> m_HudShown;
+	std::vector<Footprint> m_HudNext;
+	int m_HudLeft, m_HudTop, m_HudRight, m_HudBottom; // box holding all HUD pixels, right and bottom exclusive
+
+public:
+	FrameLayers() :
+		m_Objects(SCREEN_WIDTH * SCREEN_HEIGHT), m_Dirty(Gamefield::ClipTilesX * Gamefield::ClipTilesY), m_Valid(false),
+		m_Hud(SCREEN_WIDTH * SCREEN_HEIGHT), m_HudLeft(0), m_HudTop(0), m_HudRight(0), m_HudBottom(0) {}
+
+	// Bring both layers up to date with Commands, Field is left drawing into one of the layers
+	void Update(Gamefield& Field, const DrawCommandBuffer& Commands)
+	{
+		UpdateObjects(Field, Commands);
+		UpdateHud(Field, Commands);
+	}
+
+	// Write a whole frame into Target, Particles are added between the objects and the HUD
+	void Composite(uint32_t* Target, Gamefield& Field, const ParticleSystem& Particles, const Vec2& Origin, const Vec2& World)
+	{
+		std::deque<TargetState>::iterator state = std::find_if(m_Targets.begin(), m_Targets.end(), [&](const TargetState& t) { return t.Target == Target; });
+		if (state == m_Targets.end())
+		{
+			// Never written, or forgotten since, nothing in it can be trusted
+			memcpy(Target, m_Objects.data(), m_Objects.size() * sizeof(uint32_t));
+			if (m_Targets.size() == MaxTargets)
+				m_Targets.pop_front();
+			TargetState fresh;
+			fresh.Target = Target;
+			m_Targets.push_back(fresh);
+		}
+		else
+		{
+			CopyTiles(Target, state->Stale);
+			TargetState used = std::move(*state);
+			m_Targets.erase(state);
+			m_Targets.push_back(used);
+		}
+
+		std::vector<uint8_t>& stale = m_Targets.back().Stale;
+		stale.assign(m_Dirty.size(), 0);
+
+		Field.SetBoard(Target);
+		Field.DrawParticles(Particles, Origin, World, stale.data());
+
+		OverlayHud(Target, stale);
+	}
+
+private:
+	void UpdateObjects(Gamefield& Field, const DrawCommandBuffer& Commands)
+	{
+		CollectFootprints(Commands, LAYER_PLAYER, LAYER_ASTEROIDS, m_Current);
+		Field.SetBoard(m_Objects.data());
+
+		if (!m_Valid || MarkChanges(Field.GetWrap()) * 2 > int(m_Dirty.size()))
+		{
+			// Too much moved to be worth tracking
+			memset(m_Objects.data(), 0, m_Objects.size() * sizeof(uint32_t));
+			Field.Execute(Commands, LAYER_PLAYER, LAYER_ASTEROIDS);
+			std::fill(m_Dirty.begin(), m_Dirty.end(), uint8_t(1));
+			m_Valid = true;
+		}
+		else
+		{
+			ClearDirtyTiles();
+
+			m_Selected.assign(Commands.Size(), 0);
+			for (size_t i = 0; i < m_Current.size(); i++)
+				m_Selected[m_Current[i].Index] = TouchesDirtyTile(m_Current[i], Field.GetWrap());
+
+			Field.SetClip(m_Dirty.data());
+			Field.Execute(Commands, LAYER_PLAYER, LAYER_ASTEROIDS, [this](size_t Index) { return m_Selected[Index] != 0; });
+			Field.SetClip(nullptr);
+		}
+
+		m_Previous.swap(m_Current);
+
+		// Every target now lags behind the object layer where it changed
+		for (size_t t = 0; t < m_Targets.size(); t++)
+			for (size_t i = 0; i < m_Dirty.size(); i++)
+				m_Targets[t].Stale[i] |= m_Dirty[i];
+	}
+
+	void UpdateHud(Gamefield& Field, const DrawCommandBuffer& Commands)
+	{
+		CollectFootprints(Commands, LAYER_HUD, LAYER_HUD, m_HudNext);
+		if (m_HudNext.size() == m_HudShown.size() && std::equal(m_HudNext.begin(), m_HudNext.end(), m_HudShown.begin(), IsSameFootprint))
+			return;
+		m_HudShown.swap(m_HudNext);
+
+		// Text never leaves the boxes of its footprints, only the old and the new box are cleared
+		ClearHudBox();
+		SetHudBox();
+		ClearHudBox();
+
+		Field.SetBoard(m_Hud.data());
+		Field.Execute(Commands, LAYER_HUD, LAYER_HUD);
+	}
+
+	// Box around the shown footprints, the overlay only walks that part of the screen. Text that
+	// crosses an edge may wrap around, the box is then the whole screen.
+	void SetHudBox()
+	{
+		m_HudLeft = SCREEN_WIDTH;
+		m_HudTop = SCREEN_HEIGHT;
+		m_HudRight = 0;
+		m_HudBottom = 0;
+		for (size_t i = 0; i < m_HudShown.size(); i++)
+		{
+			const Footprint& print = m_HudShown[i];
+			if (print.Left < 0 || print.Top < 0 || print.Right >= SCREEN_WIDTH || print.Bottom >= SCREEN_HEIGHT)
+			{
+				m_HudLeft = 0;
+				m_HudTop = 0;
+				m_HudRight = SCREEN_WIDTH;
+				m_HudBottom = SCREEN_HEIGHT;
+				return;
+			}
+			m_HudLeft = std::min(m_HudLeft, print.Left);
+			m_HudTop = std::min(m_HudTop, print.Top);
+			m_HudRight = std::max(m_HudRight, print.Right + 1);
+			m_HudBottom = std::max(m_HudBottom, print.Bottom + 1);
+		}
+
+		if (m_HudLeft >= m_HudRight)
+		{
+			m_HudLeft = m_HudTop = m_HudRight = m_HudBottom = 0;
+			return;
+		}
+		m_HudLeft &= ~3;
+		m_HudRight = std::min((m_HudRight + 3) & ~3, SCREEN_WIDTH);
+	}
+
+	void ClearHudBox()
+	{
+		for (int y = m_HudTop; y < m_HudBottom; y++)
+			memset(m_Hud.data() + y * SCREEN_WIDTH + m_HudLeft, 0, (m_HudRight - m_HudLeft) * sizeof(uint32_t));
+	}
+
+	void OverlayHud(uint32_t* Target, std::vector<uint8_t>& Stale)
+	{
+		const int size = 1 << Gamefield::ClipTileShift;
+		for (int ty = m_HudTop / size; ty < (m_HudBottom + size - 1) / size; ty++)
+			for (int tx = m_HudLeft / size; tx < (m_HudRight + size - 1) / size; tx++)
+				Stale[ty * Gamefield::ClipTilesX + tx] = 1;
+
+		for (int y = m_HudTop; y < m_HudBottom; y++)
+		{
+			const uint32_t* hud = m_Hud.data() + y * SCREEN_WIDTH;
+			uint32_t* row = Target + y * SCREEN_WIDTH;
+			int x = m_HudLeft;
+#ifdef USE_SSE2
+			const __m128i vzero = _mm_setzero_si128();
+			for (; x + 4 <= m_HudRight; x += 4)
+			{
+				// Keep the frame where the HUD is empty, take the HUD elsewhere
+				__m128i text = _mm_loadu_si128((const __m128i*)(hud + x));
+				__m128i frame = _mm_loadu_si128((const __m128i*)(row + x));
+				__m128i keep = _mm_cmpeq_epi32(text, vzero);
+				_mm_storeu_si128((__m128i*)(row + x), _mm_or_si128(_mm_and_si128(keep, frame), text));
+			}
+#endif
+			for (; x < m_HudRight; x++)
+			{
+				if (hud[x] != 0)
+					row[x] = hud[x];
+			}
+		}
+	}
+
+	// Footprints of the commands in the layer range, sorted so two frames can be merged
+	static void CollectFootprints(const DrawCommandBuffer& Commands, int FirstLayer, int LastLayer, std::vector<Footprint>& Out)
+	{
+		Out.clear();
+		for (size_t i = 0; i < Commands.Size(); i++)
+		{
+			const DrawCommand& cmd = Commands.GetCommand(i);
+			if (cmd.Layer < FirstLayer || cmd.Layer > LastLayer || cmd.Count == 0)
+				continue;
+
+			Footprint print;
+			print.Hash = cmd.Hash;
+			print.Count = cmd.Count;
+			print.Index = uint32_t(i);
+			if (cmd.Type == DRAW_TEXT)
+			{
+				// Glyphs are 10x20 on a 15 pixel pitch
+				print.Left = int(cmd.Origin.x);
+				print.Top = int(cmd.Origin.y);
+				print.Right = print.Left + int(cmd.Count - 1) * 15 + 10;
+				print.Bottom = print.Top + 20;
+			}
+			else
+			{
+				// The rasterizer never leaves the box of the truncated vertices
+				const Vec2* vertices = Commands.GetVertices(cmd);
+				print.Left = print.Right = int(vertices[0].x);
+				print.Top = print.Bottom = int(vertices[0].y);
+				for (uint32_t v = 1; v < cmd.Count; v++)
+				{
+					print.Left = std::min(print.Left, int(vertices[v].x));
+					print.Right = std::max(print.Right, int(vertices[v].x));
+					print.Top = std::min(print.Top, int(vertices[v].y));
+					print.Bottom = std::max(print.Bottom, int(vertices[v].y));
+				}
+			}
+			Out.push_back(print);
+		}
+		std::sort(Out.begin(), Out.end());
+	}
+
+	static bool IsSameFootprint(const Footprint& a, const Footprint& b)
+	{
+		return !(a < b) && !(b < a);
+	}
+
+	// Mark the tiles of footprints found in only one of the two frames, returns the dirty tile count
+	int MarkChanges(bool Wrap)
+	{
+		std::fill(m_Dirty.begin(), m_Dirty.end(), uint8_t(0));
+
+		size_t i = 0, j = 0;
+		while (i < m_Previous.size() || j < m_Current.size())
+		{
+			if (j == m_Current.size() || (i < m_Previous.size() && m_Previous[i] < m_Current[j]))
+				MarkTiles(m_Previous[i++], Wrap);
+			else if (i == m_Previous.size() || m_Current[j] < m_Previous[i])
+				MarkTiles(m_Current[j++], Wrap);
+			else
+				i++, j++;
+		}
+
+		return int(std::count(m_Dirty.begin(), m_Dirty.end(), uint8_t(1)));
+	}
+
+	void MarkTiles(const Footprint& Print, bool Wrap)
+	{
+		int left, top, right, bottom;
+		if (!GetTileRange(Print, Wrap, left, top, right, bottom))
+			return;
+
+		for (int ty = top; ty <= bottom; ty++)
+			for (int tx = left; tx <= right; tx++)
+				m_Dirty[WrapTile(ty, Gamefield::ClipTilesY) * Gamefield::ClipTilesX + WrapTile(tx, Gamefield::ClipTilesX)] = 1;
+	}
+
+	bool TouchesDirtyTile(const Footprint& Print, bool Wrap) const
+	{
+		int left, top, right, bottom;
+		if (!GetTileRange(Print, Wrap, left, top, right, bottom))
+			return false;
+
+		for (int ty = top; ty <= bottom; ty++)
+			for (int tx = left; tx <= right; tx++)
+				if (m_Dirty[WrapTile(ty, Gamefield::ClipTilesY) * Gamefield::ClipTilesX + WrapTile(tx, Gamefield::ClipTilesX)])
+					return true;
+		return false;
+	}
+
+	// Tiles under a footprint, unwrapped when Wrap is set and clamped to the screen otherwise
+	static bool GetTileRange(const Footprint& Print, bool Wrap, int& Left, int& Top, int& Right, int& Bottom)
+	{
+		Left = TileOf(Print.Left);
+		Top = TileOf(Print.Top);
+		Right = TileOf(Print.Right);
+		Bottom = TileOf(Print.Bottom);
+		if (Wrap)
+		{
+			Right = std::min(Right, Left + Gamefield::ClipTilesX - 1);
+			Bottom = std::min(Bottom, Top + Gamefield::ClipTilesY - 1);
+			return true;
+		}
+
+		Left = std::max(Left, 0);
+		Top = std::max(Top, 0);
+		Right = std::min(Right, Gamefield::ClipTilesX - 1);
+		Bottom = std::min(Bottom, Gamefield::ClipTilesY - 1);
+		return Left <= Right && Top <= Bottom;
+	}
+
+	static int TileOf(int Pixel)
+	{
+		const int size = 1 << Gamefield::ClipTileShift;
+		return Pixel >= 0 ? Pixel / size : (Pixel - size + 1) / size;
+	}
+
+	static int WrapTile(int Tile, int Count)
+	{
+		return (Tile % Count + Count) % Count;
+	}
+
+	void ClearDirtyTiles()
+	{
+		ForEachTileRun(m_Dirty, [this](int Offset, int Width)
+		{
+			memset(m_Objects.data() + Offset, 0, Width * sizeof(uint32_t));
+		});
+	}
+
+	void CopyTiles(uint32_t* Target, const std::vector<uint8_t>& Tiles) const
+	{
+		ForEachTileRun(Tiles, [&](int Offset, int Width)
+		{
+			memcpy(Target + Offset, m_Objects.data() + Offset, Width * sizeof(uint32_t));
+		});
+	}
+
+	// Row pieces of the marked tiles, neighbouring tiles of a row are merged into one piece
+	template <typename Visit>
+	static void ForEachTileRun(const std::vector<uint8_t>& Tiles, Visit visit)
+	{
+		const int size = 1 << Gamefield::ClipTileShift;
+		for (int ty = 0; ty < Gamefield::ClipTilesY; ty++)
+		{
+			const uint8_t* row = Tiles.data() + ty * Gamefield::ClipTilesX;
+			for (int tx = 0; tx < Gamefield::ClipTilesX; tx++)
+			{
+				if (!row[tx])
+					continue;
+
+				int run = 1;
+				while (tx + run < Gamefield::ClipTilesX && row[tx + run])
+					run++;
+
+				for (int y = ty * size; y < (ty + 1) * size; y++)
+					visit(y * SCREEN_WIDTH + tx * size, run * size);
+				tx += run - 1;
+			}
+		}
+	}
+};
+
+// One bit per screen pixel, set where an asteroid is. Shapes are rasterized with the Gamefield line
+// rasterizer and filled row by row, tests AND whole 64-pixel words, so a hit is pixel exact and the
+// cost is bound by screen area rather than by the number of object pairs.
+class CollisionMask
+{
+public:
+	static const int WordsPerRow = SCREEN_WIDTH / 64;
+
+private:
+	std::vector<uint64_t> m_Bits;
+	bool m_Wrap;
+
+	// Row spans of the shape being processed, rows counted from m_Top
+	int m_Top;
+	std::vector<int> m_Left;
+	std::vector<int> m_Right;
+
+	// Spans of the first shape while two shapes are tested against each other
+	int m_OtherTop;
+	std::vector<int> m_OtherLeft;
+	std::vector<int> m_OtherRight;
+
+public:
+	CollisionMask() : m_Bits(WordsPerRow * SCREEN_HEIGHT), m_Wrap(true), m_Top(0), m_OtherTop(0) {}
+
+	// Same convention as Gamefield: wrap around screen edges or clip
+	void SetWrap(bool Wrap)
+	{
+		m_Wrap = Wrap;
+	}
+
+	void Clear()
+	{
+		std::fill(m_Bits.begin(), m_Bits.end(), 0);
+	}
+
+	void FillPolygon(const Vec2* Points, int Count)
+	{
+		BuildSpans(Points, Count);
+		for (size_t row = 0; row < m_Left.size(); row++)
+		{
+			if (m_Left[row] <= m_Right[row])
+				ForEachSpanWord(m_Top + int(row), m_Left[row], m_Right[row], [](uint64_t& word, uint64_t bits) { word |= bits; return false; });
+		}
+	}
+
+	// True if any pixel of the filled polygon is occupied
+	bool TestPolygon(const Vec2* Points, int Count)
+	{
+		BuildSpans(Points, Count);
+		for (size_t row = 0; row < m_Left.size(); row++)
+		{
+			if (m_Left[row] <= m_Right[row] && ForEachSpanWord(m_Top + int(row), m_Left[row], m_Right[row], [](uint64_t& word, uint64_t bits) { return (word & bits) != 0; }))
+				return true;
+		}
+		return false;
+	}
+
+	// True if the filled polygons share a pixel on screen, ignores the mask. Tells which shape
+	// a mask hit belongs to.
+	bool TestOverlap(const Vec2* A, int CountA, const Vec2* B, int CountB)
+	{
+		BuildSpans(A, CountA);
+		m_OtherTop = m_Top;
+		m_OtherLeft.swap(m_Left);
+		m_OtherRight.swap(m_Right);
+		BuildSpans(B, CountB);
+
+		// With wrapping the shapes may meet across an edge
+		int shifts = m_Wrap ? 1 : 0;
+		for (int dy = -shifts; dy <= shifts; dy++)
+			for (int dx = -shifts; dx <= shifts; dx++)
+				if (SpansOverlap(dx * SCREEN_WIDTH, dy * SCREEN_HEIGHT))
+					return true;
+		return false;
+	}
+
+private:
+	// Current spans moved by (Dx, Dy) against the other spans
+	bool SpansOverlap(int Dx, int Dy)
+	{
+		for (size_t row = 0; row < m_Left.size(); row++)
+		{
+			if (m_Left[row] > m_Right[row])
+				continue;
+
+			int y = m_Top + int(row) + Dy;
+			int other = y - m_OtherTop;
+			if (other < 0 || other >= int(m_OtherLeft.size()) || (!m_Wrap && (y < 0 || y >= SCREEN_HEIGHT)))
+				continue;
+
+			int x0 = std::max(m_Left[row] + Dx, m_OtherLeft[other]);
+			int x1 = std::min(m_Right[row] + Dx, m_OtherRight[other]);
+			if (!m_Wrap)
+			{
+				x0 = std::max(x0, 0);
+				x1 = std::min(x1, SCREEN_WIDTH - 1);
+			}
+			if (x0 <= x1)
+				return true;
+		}
+		return false;
+	}
+
+	void BuildSpans(const Vec2* Points, int Count)
+	{
+		// Our shapes are convex, so the outline's leftmost and rightmost pixel bound each row
+		float top = Points[0].y;
+		float bottom = Points[0].y;
+		for (int i = 1; i < Count; i++)
+		{
+			top = std::min(top, Points[i].y);
+			bottom = std::max(bottom, Points[i].y);
+		}
+
+		m_Top = int(top) - 1;
+		int rows = int(bottom) - m_Top + 2;
+		m_Left.assign(rows, INT32_MAX);
+		m_Right.assign(rows, INT32_MIN);
+
+		Gamefield::RasterPolygon(Points, Count, [&](int x, int y)
+		{
+			int row = y - m_Top;
+			if (row < 0 || row >= rows)
+				return;
+			m_Left[row] = std::min(m_Left[row], x);
+			m_Right[row] = std::max(m_Right[row], x);
+		});
+	}
+
+	// Visit the words covering [x0, x1] of row y with the bits of the span inside each word,
+	// stops as soon as Visit returns true
+	template <typename Visit>
+	bool ForEachSpanWord(int y, int x0, int x1, Visit visit)
+	{
+		if (m_Wrap)
+		{
+			// Shapes overhang an edge by less than a screen, so at most one extra piece per axis
+			if (y < 0) y += SCREEN_HEIGHT;
+			if (y >= SCREEN_HEIGHT) y -= SCREEN_HEIGHT;
+			if (y < 0 || y >= SCREEN_HEIGHT)
+				return false;
+
+			if (x1 < 0)
+			{
+				x0 += SCREEN_WIDTH;
+				x1 += SCREEN_WIDTH;
+			}
+			else if (x0 >= SCREEN_WIDTH)
+			{
+				x0 -= SCREEN_WIDTH;
+				x1 -= SCREEN_WIDTH;
+			}
+			if (x0 < 0)
+				return ForEachSpanWord(y, x0 + SCREEN_WIDTH, SCREEN_WIDTH - 1, visit) || ForEachSpanWord(y, 0, x1, visit);
+			if (x1 >= SCREEN_WIDTH)
+				return ForEachSpanWord(y, x0, SCREEN_WIDTH - 1, visit) || ForEachSpanWord(y, 0, x1 - SCREEN_WIDTH, visit);
+		}
+
+		if (y < 0 || y >= SCREEN_HEIGHT)
+			return false;
+		x0 = std::max(x0, 0);
+		x1 = std::min(x1, SCREEN_WIDTH - 1);
+
+		uint64_t* row = m_Bits.data() + y * WordsPerRow;
+		for (int word = x0 >> 6; word <= x1 >> 6; word++)
+		{
+			int from = std::max(x0, word << 6) & 63;
+			int to = std::min(x1, (word << 6) + 63) & 63;
+			uint64_t bits = (~0ull >> (63 - to)) & (~0ull << from);
+			if (visit(row[word], bits))
+				return true;
+		}
+		return false;
+	}
+};
+
+// Value of an environment variable, false if it is not set
+static bool ReadEnv(const char* Name, std::string& Value)
+{
+#ifdef _MSC_VER
+	char* raw = nullptr;
+	size_t length = 0;
+	if (_dupenv_s(&raw, &length, Name) != 0 || raw == nullptr)
+		return false;
+	Value = raw;
+	free(raw);
+	return true;
+#else
+	const char* raw = getenv(Name);
+	if (raw == nullptr)
+		return false;
+	Value = raw;
+	return true;
+#endif
+}
+
+static float ReadEnvFloat(const char* Name, float Default)
+{
+	std::string value;
+	if (!ReadEnv(Name, value) || value.empty())
+		return Default;
+	return float(atof(value.c_str()));
+}
+
+// Runtime switches, taken from environment variables so the engine code stays untouched
+struct GameConfig
+{
+	float TargetFps;  // ASTEROIDS_FPS, 0 runs uncapped for benchmarks
+	int TicksPerFrame; // ASTEROIDS_TURBO, simulation ticks per frame, 1 is normal play
+	int RenderEvery;   // ASTEROIDS_RENDER_EVERY, draw 1 frame in K, 0 never draws
+	std::string SharedFrames; // ASTEROIDS_SHM, shm_open name frames are exported to, empty to disable
+	int SharedFrameSlots;     // ASTEROIDS_SHM_SLOTS, frames in the shared ring
+	int WorldScale;           // ASTEROIDS_WORLD, world size in screens per side, 1 is the classic single screen
+	int WorldAsteroids;       // ASTEROIDS_WORLD_ASTEROIDS, field size in a large world
+	bool MaskCollision;       // ASTEROIDS_COLLISION=mask, pixel exact hits instead of circles
+	unsigned Seed;            // ASTEROIDS_SEED, fixed random sequence, 0 seeds from the clock
+	float FixedDt;            // ASTEROIDS_FIXED_DT, seconds per tick instead of wall time, 0 to disable
+	bool Autopilot;           // ASTEROIDS_AUTOPILOT=1, the game plays itself
+	float SoakMinutes;        // ASTEROIDS_SOAK_MINUTES, simulated minutes to soak for, 0 is normal play
+	std::string SoakCsv;      // ASTEROIDS_SOAK_CSV, per-minute soak statistics
+	float SoakTolerance;      // ASTEROIDS_SOAK_TOLERANCE, allowed growth over the run relative to the mean, above fixed floors
+	std::string SaveFrame;    // ASTEROIDS_SAVE_FRAME, draw commands of the last frame are written here at exit
+	std::string Replay;       // ASTEROIDS_REPLAY, saved draw commands to rasterize instead of playing
+	int ReplayRuns;           // ASTEROIDS_REPLAY_RUNS, times the saved frame is rasterized
+	std::string LatencyLog;   // ASTEROIDS_LATENCY_LOG, input latency and frame pacing report at exit, empty for stderr
+
+	static GameConfig FromEnvironment()
+	{
+		GameConfig config;
+		config.TargetFps = std::max(0.0f, ReadEnvFloat("ASTEROIDS_FPS", 60.0f));
+		config.TicksPerFrame = std::max(1, int(ReadEnvFloat("ASTEROIDS_TURBO", 1.0f)));
+		config.RenderEvery = std::max(0, int(ReadEnvFloat("ASTEROIDS_RENDER_EVERY", 1.0f)));
+		ReadEnv("ASTEROIDS_SHM", config.SharedFrames);
+		config.SharedFrameSlots = int(ReadEnvFloat("ASTEROIDS_SHM_SLOTS", 4.0f));
+		config.WorldScale = std::max(1, int(ReadEnvFloat("ASTEROIDS_WORLD", 1.0f)));
+		config.WorldAsteroids = std::max(1, int(ReadEnvFloat("ASTEROIDS_WORLD_ASTEROIDS", 5.0f * config.WorldScale * config.WorldScale)));
+
+		std::string collision;
+		config.MaskCollision = ReadEnv("ASTEROIDS_COLLISION", collision) && collision == "mask";
+
+		std::string seed;
+		config.Seed = ReadEnv("ASTEROIDS_SEED", seed) ? unsigned(strtoul(seed.c_str(), nullptr, 10)) : 0;
+		config.FixedDt = std::max(0.0f, ReadEnvFloat("ASTEROIDS_FIXED_DT", 0.0f));
+		config.Autopilot = ReadEnvFloat("ASTEROIDS_AUTOPILOT", 0.0f) != 0.0f;
+		config.SoakMinutes = std::max(0.0f, ReadEnvFloat("ASTEROIDS_SOAK_MINUTES", 0.0f));
+		if (!ReadEnv("ASTEROIDS_SOAK_CSV", config.SoakCsv) || config.SoakCsv.empty())
+			config.SoakCsv = "soak.csv";
+		config.SoakTolerance = ReadEnvFloat("ASTEROIDS_SOAK_TOLERANCE", 0.25f);
+		ReadEnv("ASTEROIDS_SAVE_FRAME", config.SaveFrame);
+		ReadEnv("ASTEROIDS_REPLAY", config.Replay);
+		config.ReplayRuns = std::max(1, int(ReadEnvFloat("ASTEROIDS_REPLAY_RUNS", 1000.0f)));
+#ifdef _WIN32
+		// The windowed build has no console to print to
+		if (!ReadEnv("ASTEROIDS_LATENCY_LOG", config.LatencyLog) || config.LatencyLog.empty())
+			config.LatencyLog = "latency.log";
+#else
+		ReadEnv("ASTEROIDS_LATENCY_LOG", config.LatencyLog);
+#endif
+		return config;
+	}
+
+	bool IsTurbo() const
+	{
+		return TicksPerFrame > 1 || RenderEvery != 1;
+	}
+};
+
+// Keeps frames at a fixed rate without burning a core: sleeps for most of the
+// remaining time and spins only for the last bit, where sleep is not precise.
+// The spin margin follows how much the OS actually oversleeps.
+class FramePacer
+{
+private:
+	static const size_t MaxSamples = 1 << 16;
+
+	double m_Period;     // seconds, 0 = uncapped
+	double m_Deadline;
+	double m_LastFrame;
+	double m_SpinMargin;
+	int m_Missed;
+	std::vector<float> m_Intervals; // ms
+
+public:
+	FramePacer() : m_Period(0.0), m_Deadline(0.0), m_LastFrame(0.0), m_SpinMargin(0.001), m_Missed(0)
+	{
+#ifdef _WIN32
+		// Default scheduler tick is ~15.6 ms which makes sleep useless for pacing
+		timeBeginPeriod(1);
+#endif
+	}
+
+	~FramePacer()
+	{
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	void SetTargetRate(float Fps)
+	{
+		m_Period = Fps > 0.0f ? 1.0 / Fps : 0.0;
+		m_Deadline = 0.0;
+	}
+
+	// Block until the next frame is due
+	void Wait()
+	{
+		double now = NowSeconds();
+
+		if (m_Period > 0.0)
+		{
+			m_Deadline = m_Deadline == 0.0 ? now : m_Deadline + m_Period;
+
+			if (now > m_Deadline)
+			{
+				// Late: start a new schedule instead of rushing frames to catch up
+				if (now - m_Deadline > m_Period * 0.5)
+					m_Missed++;
+				m_Deadline = now;
+			}
+			else
+			{
+				double sleep = m_Deadline - now - m_SpinMargin;
+				if (sleep > 0.0)
+				{
+					std::this_thread::sleep_for(std::chrono::duration<double>(sleep));
+					double woke = NowSeconds();
+					double oversleep = woke - now - sleep;
+
+					// Grow at once after a bad wake-up
+					m_SpinMargin = std::max(oversleep * 1.25, m_SpinMargin);
+					now = woke;
+				}
+
+				while (now < m_Deadline)
+				{
+					std::this_thread::yield();
+					now = NowSeconds();
+				}
+			}
+
+			// Shrink slowly back on every frame, slept or not, and keep the margin under half
+			// a period so some sleep is always attempted and the oversleep estimate can recover
+			m_SpinMargin = std::min(std::max(m_SpinMargin * 0.98, 0.0002), m_Period * 0.5);
+		}
+
+		if (m_LastFrame > 0.0)
+		{
+			if (m_Intervals.size() == MaxSamples)
+				m_Intervals.erase(m_Intervals.begin(), m_Intervals.begin() + MaxSamples / 2);
+			m_Intervals.push_back(float((now - m_LastFrame) * 1000.0));
+		}
+		m_LastFrame = now;
+	}
+
+	void Report(FILE* Out) const
+	{
+		if (m_Intervals.empty())
+			return;
+
+		double sum = 0.0;
+		for (size_t i = 0; i < m_Intervals.size(); i++)
+			sum += m_Intervals[i];
+		double mean = sum / m_Intervals.size();
+
+		// Jitter is the spread of frame intervals around their mean
+		double variance = 0.0;
+		std::vector<float> deviation(m_Intervals.size());
+		for (size_t i = 0; i < m_Intervals.size(); i++)
+		{
+			double d = m_Intervals[i] - mean;
+			variance += d * d;
+			deviation[i] = float(fabs(d));
+		}
+
+		fprintf(Out, "frame pacing: target %.3f ms, mean %.3f ms, stddev %.3f ms, p99 jitter %.3f ms, max jitter %.3f ms, missed %d, spin margin %.3f ms\n",
+			m_Period * 1000.0, mean, sqrt(variance / m_Intervals.size()), Percentile(deviation, 0.99f), Percentile(deviation, 1.0f), m_Missed, m_SpinMargin * 1000.0);
+	}
+
+private:
+	static float Percentile(std::vector<float> Samples, float Fraction)
+	{
+		size_t n = std::min(Samples.size() - 1, size_t(Fraction * Samples.size()));
+		std::nth_element(Samples.begin(), Samples.begin() + n, Samples.end());
+		return Samples[n];
+	}
+};
+
+// Simulation throughput for turbo runs, printed every few seconds and at exit
+class TurboStats
+{
+private:
+	static constexpr double ReportInterval = 5.0;
+
+	double m_Start;
+	double m_LastReport;
+	uint64_t m_Ticks;
+	uint64_t m_Frames;
+	uint64_t m_DrawnFrames;
+	double m_SimulatedTime;
+
+public:
+	TurboStats() : m_Start(0.0), m_LastReport(0.0), m_Ticks(0), m_Frames(0), m_DrawnFrames(0), m_SimulatedTime(0.0) {}
+
+	void OnFrame(int Ticks, float dt, FILE* Out)
+	{
+		double now = NowSeconds();
+		if (m_Start == 0.0)
+			m_Start = m_LastReport = now;
+
+		m_Ticks += Ticks;
+		m_Frames++;
+		m_SimulatedTime += double(Ticks) * dt;
+
+		if (Out && now - m_LastReport > ReportInterval)
+		{
+			Report(Out);
+			m_LastReport = now;
+		}
+	}
+
+	void OnDraw()
+	{
+		m_DrawnFrames++;
+	}
+
+	void Report(FILE* Out) const
+	{
+		double wall = std::max(NowSeconds() - m_Start, 1e-9);
+		fprintf(Out, "turbo: %llu ticks in %.2f s, %.0f ticks/s, simulated %.1f s (%.1fx real time), drew %llu of %llu frames\n",
+			(unsigned long long)m_Ticks, wall, m_Ticks / wall, m_SimulatedTime, m_SimulatedTime / wall, (unsigned long long)m_DrawnFrames, (unsigned long long)m_Frames);
+	}
+};
+
+// Backbuffer frames published through POSIX shared memory for recorders, encoders and the like.
+// The game composites straight into a ring of frames inside the shared region, copying into each
+// slot only the tiles that changed since that slot was last written, and never waits for readers.
+//
+// Layout: one page of SharedFrameHeader, then SlotCount page-aligned frames of Height * Stride bytes.
+// Every slot has a sequence counter: odd while the frame is written, 2 * (frame + 1) once it is done.
+// Reading frame n: load Sequence of slot n % SlotCount, use the pixels, load Sequence again;
+// the frame is intact if both loads returned the same even value. Published counts finished frames,
+// on Linux readers can sleep on it with FUTEX_WAIT.
+struct SharedFrameHeader
+{
+	static const uint32_t MagicValue = 0x31424641; // "AFB1"
+	static const int MaxSlots = 16;
+
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t Stride;
+	uint32_t SlotCount;
+	uint64_t FrameOffset;
+	uint64_t FrameBytes;
+#ifdef USE_SHARED_FRAMES
+	std::atomic<uint32_t> Published;
+	uint32_t Reserved;
+	std::atomic<uint64_t> Sequence[MaxSlots];
+#endif
+};
+
+class FrameExport
+{
+private:
+	static const size_t PageSize = 4096;
+
+	std::string m_Name;
+	int m_File;
+	unsigned char* m_Region;
+	size_t m_RegionSize;
+	SharedFrameHeader* m_Header;
+	uint64_t m_Frame;
+	int m_Slot;
+
+public:
+	FrameExport() : m_File(-1), m_Region(nullptr), m_RegionSize(0), m_Header(nullptr), m_Frame(0), m_Slot(-1) {}
+
+	~FrameExport()
+	{
+		Close();
+	}
+
+	bool IsOpen() const
+	{
+		return m_Header != nullptr;
+	}
+
+	bool Open(const std::string& Name, int Slots)
+	{
+#ifdef USE_SHARED_FRAMES
+		Close();
+		Slots = std::min(std::max(Slots, 2), int(SharedFrameHeader::MaxSlots));
+
+		size_t frameBytes = (size_t(SCREEN_WIDTH) * SCREEN_HEIGHT * sizeof(uint32_t) + PageSize - 1) & ~(PageSize - 1);
+		size_t regionSize = PageSize + frameBytes * Slots;
+
+		// Never share a region with another writer. A leftover name, from a crash or another instance,
+		// is unlinked and replaced; a live owner keeps its own mapping and is not disturbed.
+		int file = shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (file < 0 && errno == EEXIST)
+		{
+			fprintf(stderr, "shared memory '%s' already exists, replacing it\n", Name.c_str());
+			shm_unlink(Name.c_str());
+			file = shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		}
+		if (file < 0)
+			return false;
+
+		void* region = MAP_FAILED;
+		if (ftruncate(file, off_t(regionSize)) == 0)
+			region = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (region == MAP_FAILED)
+		{
+			close(file);
+			shm_unlink(Name.c_str());
+			return false;
+		}
+
+		m_Name = Name;
+		m_File = file;
+		m_Region = (unsigned char*)region;
+		m_RegionSize = regionSize;
+		m_Frame = 0;
+
+		// Fill the header first, Magic last so readers never see a half-initialized one
+		m_Header = new (m_Region) SharedFrameHeader;
+		m_Header->Version = 1;
+		m_Header->Width = SCREEN_WIDTH;
+		m_Header->Height = SCREEN_HEIGHT;
+		m_Header->Stride = SCREEN_WIDTH * sizeof(uint32_t);
+		m_Header->SlotCount = uint32_t(Slots);
+		m_Header->FrameOffset = PageSize;
+		m_Header->FrameBytes = frameBytes;
+		m_Header->Published.store(0, std::memory_order_relaxed);
+		for (int i = 0; i < SharedFrameHeader::MaxSlots; i++)
+			m_Header->Sequence[i].store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_Header->Magic = SharedFrameHeader::MagicValue;
+		return true;
+#else
+		(void)Name;
+		(void)Slots;
+		return false;
+#endif
+	}
+
+	void Close()
+	{
+#ifdef USE_SHARED_FRAMES
+		if (!m_Region)
+			return;
+
+		// Another instance may have replaced the name since, only unlink it if it is still ours.
+		// Readers that still have the region mapped keep their mapping.
+		if (IsNameOurs())
+			shm_unlink(m_Name.c_str());
+		munmap(m_Region, m_RegionSize);
+		close(m_File);
+		m_Region = nullptr;
+		m_Header = nullptr;
+		m_File = -1;
+#endif
+	}
+
+	// Slot to render the next frame into
+	uint32_t* BeginFrame()
+	{
+#ifdef USE_SHARED_FRAMES
+		m_Slot = int(m_Frame % m_Header->SlotCount);
+		m_Header->Sequence[m_Slot].store(2 * m_Frame + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		return (uint32_t*)(m_Region + m_Header->FrameOffset + m_Slot * m_Header->FrameBytes);
+#else
+		return nullptr;
+#endif
+	}
+
+	void EndFrame()
+	{
+#ifdef USE_SHARED_FRAMES
+		m_Header->Sequence[m_Slot].store(2 * m_Frame + 2, std::memory_order_release);
+		m_Header->Published.store(uint32_t(m_Frame + 1), std::memory_order_release);
+		m_Frame++;
+
+#ifdef __linux__
+		syscall(SYS_futex, &m_Header->Published, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+#endif
+	}
+
+private:
+#ifdef USE_SHARED_FRAMES
+	bool IsNameOurs() const
+	{
+		int file = shm_open(m_Name.c_str(), O_RDONLY, 0);
+		if (file < 0)
+			return false;
+
+		struct stat named, own;
+		bool ours = fstat(file, &named) == 0 && fstat(m_File, &own) == 0 && named.st_dev == own.st_dev && named.st_ino == own.st_ino;
+		close(file);
+		return ours;
+	}
+#endif
+};
+
+// Keys the game reacts to, one bit each in InputSnapshot
+enum InputKey : uint8_t
+{
+	KEY_LEFT,
+	KEY_RIGHT,
+	KEY_THRUST,
+	KEY_FIRE,
+	KEY_QUIT,
+	KEY_COUNT
+};
+
+static const int InputKeyCodes[KEY_COUNT] = { VK_LEFT, VK_RIGHT, VK_UP, VK_SPACE, VK_ESCAPE };
+
+// State of all keys sampled at one moment
+struct InputSnapshot
+{
+	double Time;
+	uint32_t Keys;
+
+	InputSnapshot() : Time(0.0), Keys(0) {}
+
+	bool IsDown(InputKey Key) const
+	{
+		return (Keys >> Key) & 1;
+	}
+};
+
+struct KeyTransition
+{
+	double Earliest; // previous sample, the edge cannot be older than this
+	double Time;     // sample that saw the edge, it cannot be newer than this
+	uint8_t Key;
+	bool Pressed;
+};
+
+// Samples every key once per tick so the whole tick sees a consistent input,
+// and keeps the press/release edges with their timestamps
+class InputState
+{
+private:
+	static const size_t MaxTransitions = 256;
+
+	InputSnapshot m_Current;
+	std::deque<KeyTransition> m_Transitions;
+
+public:
+	const InputSnapshot& Sample()
+	{
+		InputSnapshot next;
+		for (int key = 0; key < KEY_COUNT; key++)
+		{
+			if (is_key_pressed(InputKeyCodes[key]))
+				next.Keys |= 1u << key;
+		}
+		next.Time = NowSeconds();
+
+		// A key is polled, so its real edge happened somewhere since the previous sample
+		double earliest = m_Current.Time > 0.0 ? m_Current.Time : next.Time;
+		uint32_t changed = next.Keys ^ m_Current.Keys;
+		for (int key = 0; key < KEY_COUNT; key++)
+		{
+			if (!(changed & (1u << key)))
+				continue;
+
+			KeyTransition transition;
+			transition.Earliest = earliest;
+			transition.Time = next.Time;
+			transition.Key = uint8_t(key);
+			transition.Pressed = (next.Keys >> key) & 1;
+			if (m_Transitions.size() == MaxTransitions)
+				m_Transitions.pop_front();
+			m_Transitions.push_back(transition);
+		}
+
+		m_Current = next;
+		return m_Current;
+	}
+
+	const InputSnapshot& GetCurrent() const
+	{
+		return m_Current;
+	}
+
+	bool PopTransition(KeyTransition& Transition)
+	{
+		if (m_Transitions.empty())
+			return false;
+
+		Transition = m_Transitions.front();
+		m_Transitions.pop_front();
+		return true;
+	}
+};
+
+// Collects how old the input is when the frame it affected is written to the backbuffer. That is
+// what "present" means here: the engine blits the buffer to the window afterwards, which is not timed.
+class LatencyStats
+{
+private:
+	static const size_t MaxSamples = 1 << 16;
+
+	std::vector<float> m_SnapshotAge;    // ms, every frame
+	std::vector<float> m_PressLatencyMax; // ms, key presses timed from the sample before the one that saw them
+	std::vector<float> m_PressLatencyMin; // ms, key presses timed from the sample that saw them
+
+public:
+	void OnPresent(InputState& Input, double PresentTime)
+	{
+		AddSample(m_SnapshotAge, PresentTime - Input.GetCurrent().Time);
+
+		KeyTransition transition;
+		while (Input.PopTransition(transition))
+		{
+			if (!transition.Pressed)
+				continue;
+			AddSample(m_PressLatencyMax, PresentTime - transition.Earliest);
+			AddSample(m_PressLatencyMin, PresentTime - transition.Time);
+		}
+	}
+
+	void Report(FILE* Out) const
+	{
+		fprintf(Out, "input latency, present is the frame written to the backbuffer, before the window blit\n");
+		ReportSeries(Out, "snapshot age", m_SnapshotAge);
+		// The true latency of a press lies between the two, the upper bound includes the frame wait
+		ReportSeries(Out, "key press to present, upper bound", m_PressLatencyMax);
+		ReportSeries(Out, "key press to present, lower bound", m_PressLatencyMin);
+	}
+
+	static float Percentile(std::vector<float> Samples, float Fraction)
+	{
+		if (Samples.empty())
+			return 0.0f;
+
+		size_t n = std::min(Samples.size() - 1, size_t(Fraction * Samples.size()));
+		std::nth_element(Samples.begin(), Samples.begin() + n, Samples.end());
+		return Samples[n];
+	}
+
+private:
+	static void AddSample(std::vector<float>& Samples, double Seconds)
+	{
+		// Keep memory bounded on long sessions, the oldest half goes first
+		if (Samples.size() == MaxSamples)
+			Samples.erase(Samples.begin(), Samples.begin() + MaxSamples / 2);
+		Samples.push_back(float(Seconds * 1000.0));
+	}
+
+	static void ReportSeries(FILE* Out, const char* Name, const std::vector<float>& Samples)
+	{
+		if (Samples.empty())
+			return;
+
+		fprintf(Out, "%s: %u samples, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n", Name, unsigned(Samples.size()),
+			Percentile(Samples, 0.5f), Percentile(Samples, 0.9f), Percentile(Samples, 0.99f), Percentile(Samples, 1.0f));
+	}
+};
+
+// Asteroids away from the camera in a large world, bucketed by sector and not simulated.
+// Asteroids fly straight and do not interact with each other, so a sector is brought up to date
+// in closed form only when its content could have reached the area around the camera.
+// Per-tick cost depends on the number of sectors and on what is near the camera, not on population.
+class SectorGrid
+{
+private:
+	struct Dormant
+	{
+		Flying_Object Object;
+		double Since; // simulation time the position is valid for
+	};
+
+	struct Sector
+	{
+		std::vector<Dormant> Objects;
+		double Oldest;
+	};
+
+	Vec2 m_World;
+	float m_SectorSize;
+	int m_Columns;
+	int m_Rows;
+	float m_MaxSpeed;
+	size_t m_Count;
+	std::vector<Sector> m_Sectors;
+	std::vector<Dormant> m_Waking;
+
+public:
+	SectorGrid() : m_SectorSize(1.0f), m_Columns(0), m_Rows(0), m_MaxSpeed(0.0f), m_Count(0) {}
+
+	void Reset(const Vec2& World, float SectorSize)
+	{
+		m_World = World;
+		m_SectorSize = SectorSize;
+		m_Columns = std::max(1, int(ceilf(World.x / SectorSize)));
+		m_Rows = std::max(1, int(ceilf(World.y / SectorSize)));
+		m_Sectors.assign(m_Columns * m_Rows, Sector());
+		m_MaxSpeed = 0.0f;
+		m_Count = 0;
+	}
+
+	void Clear()
+	{
+		for (size_t i = 0; i < m_Sectors.size(); i++)
+			m_Sectors[i].Objects.clear();
+		m_Count = 0;
+	}
+
+	size_t Count() const
+	{
+		return m_Count;
+	}
+
+	void Insert(const Flying_Object& Object, double Now)
+	{
+		Vec2 pos = Object.GetPosition();
+		int column = std::min(std::max(int(pos.x / m_SectorSize), 0), m_Columns - 1);
+		int row = std::min(std::max(int(pos.y / m_SectorSize), 0), m_Rows - 1);
+		Sector& sector = m_Sectors[row * m_Columns + column];
+
+		if (sector.Objects.empty() || Now < sector.Oldest)
+			sector.Oldest = Now;
+
+		Dormant dormant = { Object, Now };
+		sector.Objects.push_back(dormant);
+		m_MaxSpeed = std::max(m_MaxSpeed, Object.GetSpeed().Length());
+		m_Count++;
+	}
+
+	// Put active asteroids that left the area to sleep and wake the ones that entered it.
+	// Wake area is Center +- HalfExtent, sleeping starts one sector further out to avoid flapping.
+	void Stream(const Vec2& Center, const Vec2& HalfExtent, double Now, std::vector<Flying_Object>& Active)
+	{
+		Vec2 sleepExtent = HalfExtent + Vec2(m_SectorSize, m_SectorSize);
+		for (size_t i = 0; i < Active.size();)
+		{
+			if (IsInside(Active[i].GetPosition(), Center, sleepExtent))
 			{
-				float y = round(k*i + b);
-				if (y > last_y)
-					for (float yy = last_y; yy < y + 1; yy++)
-						DrawPoint(i, yy, Color);
-				else
-					for (float yy = y; yy < last_y + 1; yy++)
-						DrawPoint(i, yy, Color);
-				last_y = y;
+				i++;
+				continue;
 			}
+			Insert(Active[i], Now);
+			Active[i] = Active.back();
+			Active.pop_back();
 		}
 
-		else
+		for (int row = 0; row < m_Rows; row++)
 		{
-			last_y = y1;
-			for (int i = x1; i < x0 + 1; i++)
+			for (int column = 0; column < m_Columns; column++)
 			{
-				float y = round(k*i + b);
-				if (y > last_y)
-					for (float yy = last_y; yy < y + 1; yy++)
-						DrawPoint(i, yy, Color);
-				else
-					for (float yy = y; yy < last_y + 1; yy++)
-						DrawPoint(i, yy, Color);
-				last_y = y;
+				Sector& sector = m_Sectors[row * m_Columns + column];
+				if (sector.Objects.empty())
+					continue;
+
+				// Anything in here is at most this far away from the sector by now
+				float reach = float(m_MaxSpeed * (Now - sector.Oldest));
+				Vec2 sectorCenter = Vec2((column + 0.5f) * m_SectorSize, (row + 0.5f) * m_SectorSize);
+				Vec2 delta = WrapDelta(sectorCenter - Center, m_World);
+				float half = m_SectorSize / 2 + reach;
+				if (fabsf(delta.x) > HalfExtent.x + half || fabsf(delta.y) > HalfExtent.y + half)
+					continue;
+
+				m_Waking.swap(sector.Objects);
+				m_Count -= m_Waking.size();
+				for (size_t i = 0; i < m_Waking.size(); i++)
+				{
+					Flying_Object& object = m_Waking[i].Object;
+					object.SetPosition(WrapPosition(object.GetPosition() + object.GetSpeed() * float(Now - m_Waking[i].Since)));
+
+					if (IsInside(object.GetPosition(), Center, HalfExtent))
+						Active.push_back(object);
+					else
+						Insert(object, Now);
+				}
+				m_Waking.clear();
 			}
 		}
 	}
 
-	void DrawPoint(int x, int y, uint32_t Color)
+private:
+	bool IsInside(const Vec2& Pos, const Vec2& Center, const Vec2& HalfExtent) const
 	{
-		float fx, fy;
-		LoopCoordinates(x, y, fx, fy);
-		*(m_Board + int(fy * SCREEN_WIDTH) + int(fx)) = Color;
+		Vec2 delta = WrapDelta(Pos - Center, m_World);
+		return fabsf(delta.x) <= HalfExtent.x && fabsf(delta.y) <= HalfExtent.y;
 	}
 
-	void LoopCoordinates(float in_x, float in_y, float& out_x, float& out_y)
+	Vec2 WrapPosition(const Vec2& Pos) const
 	{
-		out_x = in_x;
-		out_y = in_y;
-		if (in_x < 0) out_x = in_x + SCREEN_WIDTH;
-		if (in_x >= SCREEN_WIDTH) out_x = in_x - SCREEN_WIDTH;
-		if (in_y < 0) out_y = in_y + SCREEN_HEIGHT;
-		if (in_y >= SCREEN_HEIGHT) out_y = in_y - SCREEN_HEIGHT;
+		Vec2 wrapped = Vec2(fmodf(Pos.x, m_World.x), fmodf(Pos.y, m_World.y));
+		if (wrapped.x < 0) wrapped.x += m_World.x;
+		if (wrapped.y < 0) wrapped.y += m_World.y;
+		return wrapped;
 	}
 };
 
@@ -373,69 +2474,205 @@ private:
 	std::vector<Flying_Object> m_Asteroids;
 	std::vector<Flying_Object> m_Bullets;
 
-	// Rectangles
-	const std::vector<Vec2> m_Asteroid_Model = { Vec2(-1.0f, -1.0f), Vec2(-1.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, -1.0f) };
-	const std::vector<Vec2> m_Bullet_Model = { Vec2(-1.0f, -1.0f), Vec2(-1.0f, 1.0f), Vec2(1.0f, 1.0f), Vec2(1.0f, -1.0f) };
+	ParticleSystem m_Particles;
+	float m_ExhaustAccumulator;
+	float m_ParticleTime; // simulated since the particles were last advanced, capped past the longest lifetime
+
+	DrawCommandBuffer m_Commands;
+	FrameLayers m_Layers;
+	uint32_t* m_Target;
+
+	// World is bigger than the screen in large-world mode, the camera then follows the player
+	bool m_LargeWorld;
+	Vec2 m_WorldSize;
+	int m_WorldAsteroids;
+	SectorGrid m_Sectors;
+	double m_SimTime;
+
+	// Pixel exact collisions against an occupancy mask of the asteroids on screen
+	bool m_MaskCollision;
+	bool m_MaskStale;
+	CollisionMask m_Mask;
+	DrawCommandBuffer m_MaskShapes;
+	DrawCommandBuffer m_ProbeShape;
+	DrawCommandBuffer m_CandidateShape;
 
 public:
-	GameManager(uint32_t* board) : m_GameBoard(Gamefield(board))
+	GameManager(uint32_t* board, const GameConfig& Config) : m_GameBoard(Gamefield(board)), m_Target(board)
 	{
+		m_LargeWorld = Config.WorldScale > 1;
+		m_WorldSize = Vec2(float(SCREEN_WIDTH * Config.WorldScale), float(SCREEN_HEIGHT * Config.WorldScale));
+		m_WorldAsteroids = Config.WorldAsteroids;
+		m_SimTime = 0.0;
+		if (m_LargeWorld)
+		{
+			m_Sectors.Reset(m_WorldSize, 256.0f);
+			m_GameBoard.SetWrap(false);
+			m_Mask.SetWrap(false);
+		}
+		m_MaskCollision = Config.MaskCollision;
+		m_MaskStale = true;
+
 		Score = 0;
 		
-		m_Player = Shuttle(Vec2(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2), Vec2(), 10, 0.0f, 50);
+		m_Player = Shuttle(m_WorldSize * 0.5f, Vec2(), 10, 0.0f, 50);
 		Health = 5;
 		isInvincible = false;
 
 		ShootCD = 1.0f;
 		InvicibilityTimeOnHit = 3.0f;
 		ShootTimer = 0.0f;
+		m_ExhaustAccumulator = 0.0f;
+		m_ParticleTime = 0.0f;
 		
-		srand(time(0));
+		srand(Config.Seed != 0 ? Config.Seed : unsigned(time(0)));
 
 		SpawnAsteroidField();
 	}
 
-	void UpdateGame(float dt)
+	void UpdateGame(const InputSnapshot& Input, float dt)
 	{
-		ReadInputs(dt);
+		ReadInputs(Input, dt);
 
 		UpdatePlayerPosition(dt);
 		UpdateBulletPositions(dt);
 		UpdateAsteroidPositions(dt);
+		m_SimTime += dt;
+
+		if (m_LargeWorld)
+			StreamSectors();
 
 		CheckInteractions(dt);
+
+		// Particles are only looks, they are advanced when a frame is drawn
+		m_ParticleTime = std::min(m_ParticleTime + dt, 2.0f);
+	}
+
+	const Shuttle& GetPlayer() const
+	{
+		return m_Player;
+	}
+
+	// Asteroids in the whole world, simulated or not
+	size_t GetAsteroidCount() const
+	{
+		return m_Asteroids.size() + m_Sectors.Count();
+	}
+
+	size_t GetBulletCount() const
+	{
+		return m_Bullets.size();
+	}
+
+	size_t GetParticleCount() const
+	{
+		return size_t(m_Particles.GetCount());
+	}
+
+	// Closest simulated asteroid and its offset from the player, nullptr if there is none
+	const Flying_Object* FindNearestAsteroid(Vec2& Delta) const
+	{
+		const Flying_Object* nearest = nullptr;
+		float best = -1.0f;
+		for (std::vector<Flying_Object>::const_iterator asteroid = m_Asteroids.begin(); asteroid != m_Asteroids.end(); ++asteroid)
+		{
+			Vec2 delta = asteroid->GetPosition() - m_Player.GetPosition();
+			if (m_LargeWorld)
+				delta = WrapDelta(delta, m_WorldSize);
+
+			float distance = delta.x * delta.x + delta.y * delta.y;
+			if (best < 0.0f || distance < best)
+			{
+				best = distance;
+				Delta = delta;
+				nearest = &*asteroid;
+			}
+		}
+		return nearest;
+	}
+
+	// Draw commands of the last drawn frame, for replaying without the game
+	bool SaveLastFrame(const char* Path) const
+	{
+		return m_Commands.SaveToFile(Path);
+	}
+
+	void SetRenderTarget(uint32_t* board)
+	{
+		m_Target = board;
+		m_GameBoard.SetBoard(board);
 	}
 
+	// Every pixel of the render target is written, it does not need clearing
 	void DrawGame() 
 	{
+		m_Particles.Update(m_ParticleTime, m_WorldSize.x, m_WorldSize.y);
+		m_ParticleTime = 0.0f;
+
+		RecordFrame(m_Commands);
+		m_Layers.Update(m_GameBoard, m_Commands);
+
+		// Glow goes over the objects but under the text
+		m_Layers.Composite(m_Target, m_GameBoard, m_Particles, GetCameraOrigin(), m_WorldSize);
+	}
+
+	// Describe the current frame without touching the board
+	void RecordFrame(DrawCommandBuffer& Commands) const
+	{
+		Commands.Clear();
+		if (m_LargeWorld)
+			Commands.SetView(m_Player.GetPosition(), m_WorldSize);
+
 		// Change color for invincibility
+		Commands.SetLayer(LAYER_PLAYER);
 		if(isInvincible)
-			m_GameBoard.DrawFlyingObject(m_Player, m_GameBoard.m_Invincibility_Color);
+			Commands.PushFlyingObject(m_Player, m_GameBoard.m_Invincibility_Color);
 		else
-			m_GameBoard.DrawFlyingObject(m_Player, m_GameBoard.m_Player_Color);
+			Commands.PushFlyingObject(m_Player, m_GameBoard.m_Player_Color);
 
-		m_GameBoard.DrawFlyingObjects(m_Bullets, m_GameBoard.m_Bullet_Color);
-		m_GameBoard.DrawFlyingObjects(m_Asteroids, m_GameBoard.m_Obstacle_Color);
+		Commands.SetLayer(LAYER_BULLETS);
+		Commands.PushFlyingObjects(m_Bullets, m_GameBoard.m_Bullet_Color);
+		Commands.SetLayer(LAYER_ASTEROIDS);
+		Commands.PushFlyingObjects(m_Asteroids, m_GameBoard.m_Obstacle_Color);
 
-		m_GameBoard.DrawText(std::to_string(Score), Vec2(5.0f, 5.0f));
-		m_GameBoard.DrawText(std::to_string(Health), Vec2(5.0f, 30.0f));
+		Commands.SetLayer(LAYER_HUD);
+		Commands.PushText(std::to_string(Score), Vec2(5.0f, 5.0f), m_GameBoard.m_Text_Color);
+		Commands.PushText(std::to_string(Health), Vec2(5.0f, 30.0f), m_GameBoard.m_Text_Color);
 	}
 
 private:
-	void ReadInputs(float dt)
+	// World position of the top-left screen pixel, inside the world
+	Vec2 GetCameraOrigin() const
+	{
+		if (!m_LargeWorld)
+			return Vec2();
+
+		Vec2 origin = m_Player.GetPosition() - Vec2(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+		return WrapDelta(origin - m_WorldSize * 0.5f, m_WorldSize) + m_WorldSize * 0.5f;
+	}
+
+	// Only asteroids around the screen stay in m_Asteroids and get simulated every tick
+	void StreamSectors()
+	{
+		Vec2 halfExtent = Vec2(SCREEN_WIDTH / 2 + 256.0f, SCREEN_HEIGHT / 2 + 256.0f);
+		m_Sectors.Stream(m_Player.GetPosition(), halfExtent, m_SimTime, m_Asteroids);
+	}
+
+	void ReadInputs(const InputSnapshot& Input, float dt)
 	{
-		if (is_key_pressed(VK_LEFT))
+		if (Input.IsDown(KEY_LEFT))
 			m_Player.AddAngle(-90 * dt);
 
-		if (is_key_pressed(VK_RIGHT))
+		if (Input.IsDown(KEY_RIGHT))
 			m_Player.AddAngle(90 * dt);
 
-		if (is_key_pressed(VK_UP))
+		if (Input.IsDown(KEY_THRUST))
 		{
 			m_Player.UpdateSpeed(dt);
+			EmitExhaust(dt);
 		}
 
-		if (is_key_pressed(VK_SPACE) && ShootTimer > ShootCD)
+		if (Input.IsDown(KEY_FIRE) && ShootTimer > ShootCD)
 		{
 			SpawnBullet();
 			ShootTimer = 0;
@@ -446,10 +2683,27 @@ private:
 	void SpawnBullet()
 	{
 		// Create bullet based on player parameters
-		Flying_Object bullet = Flying_Object(m_Player.GetPosition(), Vec2(sinf(m_Player.GetAngle()*PI / 180), -cosf(m_Player.GetAngle()*PI / 180))*200.0f, 1, 0, m_Bullet_Model);
+		Flying_Object bullet = Flying_Object(m_Player.GetPosition(), Vec2(sinf(m_Player.GetAngle()*PI / 180), -cosf(m_Player.GetAngle()*PI / 180))*200.0f, 1, 0, MODEL_BULLET);
 		m_Bullets.push_back(bullet);
 	}
 
+	void EmitExhaust(float dt)
+	{
+		// Fixed rate regardless of frame time, fractional particles carried over
+		m_ExhaustAccumulator += 3000.0f * dt;
+		int count = int(m_ExhaustAccumulator);
+		m_ExhaustAccumulator -= count;
+
+		Vec2 back = Vec2(-sinf(m_Player.GetAngle()*PI / 180), cosf(m_Player.GetAngle()*PI / 180));
+		m_Particles.Emit(m_Player.GetPosition() + back * float(m_Player.GetSize()), m_Player.GetSpeed(), count, m_Player.GetAngle() + 180.0f, 15.0f, 60.0f, 160.0f, 0.6f, m_GameBoard.m_Exhaust_Color);
+	}
+
+	void EmitExplosion(const Flying_Object& Asteroid)
+	{
+		// Bigger rocks make bigger bursts
+		m_Particles.Emit(Asteroid.GetPosition(), Asteroid.GetSpeed(), Asteroid.GetSize() * 60, 0.0f, 180.0f, 10.0f, 40.0f + Asteroid.GetSize() * 8.0f, 1.2f, m_GameBoard.m_Explosion_Color);
+	}
+
 	// Next 3 just update positions for all objects
 	void UpdatePlayerPosition(float dt) 
 	{
@@ -463,6 +2717,13 @@ private:
 			UpdateObjectPosition(*it, dt);
 		}
 
+		if (m_LargeWorld)
+		{
+			// Bullets live as long as they are on screen
+			m_Bullets.erase(std::remove_if(m_Bullets.begin(), m_Bullets.end(), [&](const Flying_Object& b) {Vec2 d = WrapDelta(b.GetPosition() - m_Player.GetPosition(), m_WorldSize); return fabsf(d.x) >= SCREEN_WIDTH / 2 - 1 || fabsf(d.y) >= SCREEN_HEIGHT / 2 - 1; }), m_Bullets.end());
+			return;
+		}
+
 		m_Bullets.erase(std::remove_if(m_Bullets.begin(), m_Bullets.end(), [](const Flying_Object& b) {return b.GetPosition().x <= 0 || b.GetPosition().y <= 0 || b.GetPosition().x >= SCREEN_WIDTH-1 || b.GetPosition().y >= SCREEN_HEIGHT-1; }), m_Bullets.end());
 	}
 
@@ -486,14 +2747,17 @@ private:
 	{
 		out_x = in_x;
 		out_y = in_y;
-		if (in_x < 0) out_x = in_x + SCREEN_WIDTH;
-		if (in_x >= SCREEN_WIDTH) out_x = in_x - SCREEN_WIDTH;
-		if (in_y < 0) out_y = in_y + SCREEN_HEIGHT;
-		if (in_y >= SCREEN_HEIGHT) out_y = in_y - SCREEN_HEIGHT;
+		if (in_x < 0) out_x = in_x + m_WorldSize.x;
+		if (in_x >= m_WorldSize.x) out_x = in_x - m_WorldSize.x;
+		if (in_y < 0) out_y = in_y + m_WorldSize.y;
+		if (in_y >= m_WorldSize.y) out_y = in_y - m_WorldSize.y;
 	}
 
 	void CheckInteractions(float dt)
 	{
+		// Asteroids moved, the mask is rebuilt by the first test that needs it
+		m_MaskStale = true;
+
 		// Check all bullet-asteroid pairs for collisions (not perfect as created asteroids can't be hit)
 		std::vector<Flying_Object>::iterator bullet = m_Bullets.begin();
 
@@ -511,7 +2775,7 @@ private:
 		CheckPlayerAsteroidCollision(dt);
 
 		// If no asteroids left restart the game
-		if (m_Asteroids.empty()) 
+		if (m_Asteroids.empty() && m_Sectors.Count() == 0) 
 		{
 			SpawnAsteroidField();
 		}
@@ -521,20 +2785,34 @@ private:
 	{
 		bool flag = false;
 
+		// With the mask only a bullet that really touches something looks for its asteroid
+		std::vector<Flying_Object>::iterator target = m_Asteroids.end();
+		if (m_MaskCollision)
+		{
+			// An earlier bullet may have split an asteroid, its old pixels must not be hit again
+			if (m_MaskStale)
+				BuildCollisionMask();
+			if (!TestCollisionMask(bullet))
+				return false;
+			target = FindMaskHitAsteroid(bullet);
+		}
+
 		// Iterate over all asteroids, if hit destrou asteroid and create 2 new
 		std::vector<Flying_Object> newAsteroids;
 		std::vector<Flying_Object>::iterator asteroid = m_Asteroids.begin();
 		while (asteroid != m_Asteroids.end())
 		{
-			bool isColiding = CheckCollision(bullet.GetPosition(), asteroid->GetPosition(), (bullet.GetSize() + asteroid->GetSize()));
+			bool isColiding = m_MaskCollision ? asteroid == target : CheckCollision(bullet.GetPosition(), asteroid->GetPosition(), (bullet.GetSize() + asteroid->GetSize()));
 			flag = flag || isColiding;
 			if (isColiding) {
+				EmitExplosion(*asteroid);
 				if (asteroid->GetSize() > 5) 
 				{
 					newAsteroids.push_back(CreateAsteroid(asteroid->GetPosition(), asteroid->GetSize()/2));
 					newAsteroids.push_back(CreateAsteroid(asteroid->GetPosition(), asteroid->GetSize()/2));
 				}
 				asteroid = m_Asteroids.erase(asteroid);
+				m_MaskStale = true;
 				break;
 			}
 			else
@@ -553,7 +2831,16 @@ private:
 	bool CheckPlayerAsteroidCollision(float dt) 
 	{
 		// Loose health if healthy and not invincible
-		bool isColliding = std::any_of(m_Asteroids.begin(), m_Asteroids.end(), [&](const Flying_Object& a) {return CheckCollision(a.GetPosition(), m_Player.GetPosition(), (a.GetSize() + m_Player.GetSize())); });
+		bool isColliding;
+		if (m_MaskCollision)
+		{
+			// Bullets may have removed asteroids since the mask was built
+			if (m_MaskStale)
+				BuildCollisionMask();
+			isColliding = TestCollisionMask(m_Player);
+		}
+		else
+			isColliding = std::any_of(m_Asteroids.begin(), m_Asteroids.end(), [&](const Flying_Object& a) {return CheckCollision(a.GetPosition(), m_Player.GetPosition(), (a.GetSize() + m_Player.GetSize())); });
 		if (isColliding)
 		{
 			if (!isInvincible)
@@ -583,15 +2870,83 @@ private:
 
 	bool CheckCollision(const Vec2& obj1, const Vec2& obj2, float limit)
 	{
+		// The world seam can be on screen in a large world
+		if (m_LargeWorld)
+			return WrapDelta(obj1 - obj2, m_WorldSize).Length() < limit;
 		return (obj1 - obj2).Length() < limit;
 	}
 
+	// Record shapes in screen space the same way they are drawn, so the mask matches the picture
+	void RecordShapes(DrawCommandBuffer& Shapes, const Flying_Object* Objects, size_t Count)
+	{
+		Shapes.Clear();
+		if (m_LargeWorld)
+			Shapes.SetView(m_Player.GetPosition(), m_WorldSize);
+		for (size_t i = 0; i < Count; i++)
+			Shapes.PushFlyingObject(Objects[i], 0);
+	}
+
+	void BuildCollisionMask()
+	{
+		RecordShapes(m_MaskShapes, m_Asteroids.data(), m_Asteroids.size());
+
+		m_Mask.Clear();
+		for (size_t i = 0; i < m_MaskShapes.Size(); i++)
+		{
+			const DrawCommand& shape = m_MaskShapes.GetCommand(i);
+			m_Mask.FillPolygon(m_MaskShapes.GetVertices(shape), shape.Count);
+		}
+		m_MaskStale = false;
+	}
+
+	bool TestCollisionMask(const Flying_Object& Object)
+	{
+		RecordShapes(m_ProbeShape, &Object, 1);
+		if (m_ProbeShape.Size() == 0)
+			return false;
+
+		const DrawCommand& shape = m_ProbeShape.GetCommand(0);
+		return m_Mask.TestPolygon(m_ProbeShape.GetVertices(shape), shape.Count);
+	}
+
+	// The mask only knows that something was hit. Of the asteroids that can reach the bullet take
+	// the closest one whose own shape the bullet overlaps. Expects the bullet in m_ProbeShape.
+	std::vector<Flying_Object>::iterator FindMaskHitAsteroid(const Flying_Object& bullet)
+	{
+		const DrawCommand& probe = m_ProbeShape.GetCommand(0);
+		const Vec2* probeVertices = m_ProbeShape.GetVertices(probe);
+
+		std::vector<Flying_Object>::iterator best = m_Asteroids.end();
+		float bestDistance = 0.0f;
+		for (std::vector<Flying_Object>::iterator asteroid = m_Asteroids.begin(); asteroid != m_Asteroids.end(); ++asteroid)
+		{
+			// The mask wraps at the screen edges, which are the world edges outside large-world mode
+			Vec2 delta = WrapDelta(asteroid->GetPosition() - bullet.GetPosition(), m_WorldSize);
+
+			// Squared distances, corners of a square are size * sqrt(2) away from its center
+			float reach = (asteroid->GetSize() + bullet.GetSize()) * 1.5f;
+			float distance = delta.x * delta.x + delta.y * delta.y;
+			if (distance >= reach * reach || (best != m_Asteroids.end() && distance >= bestDistance))
+				continue;
+
+			RecordShapes(m_CandidateShape, &*asteroid, 1);
+			if (m_CandidateShape.Size() == 0)
+				continue;
+
+			const DrawCommand& shape = m_CandidateShape.GetCommand(0);
+			if (m_Mask.TestOverlap(m_CandidateShape.GetVertices(shape), shape.Count, probeVertices, probe.Count))
+			{
+				best = asteroid;
+				bestDistance = distance;
+			}
+		}
+		return best;
+	}
+
 	void Loose() 
 	{
 		// Basically restart
-		m_GameBoard.Clear();
-
-		m_Player = Shuttle(Vec2(SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2), Vec2(), 10, 0.0f, 50);
+		m_Player = Shuttle(m_WorldSize * 0.5f, Vec2(), 10, 0.0f, 50);
 
 		Score = 0;
 		Health = 5;
@@ -600,10 +2955,18 @@ private:
 
 		m_Asteroids.clear();
 		m_Bullets.clear();
+		m_Particles.Clear();
+		m_Sectors.Clear();
 	}
 
 	void SpawnAsteroidField() 
 	{
+		if (m_LargeWorld)
+		{
+			SpawnWorldAsteroidField();
+			return;
+		}
+
 		for (int i = 0; i < 5; i++) 
 		{
 			int randPoint = int((float(rand()) / float(RAND_MAX / float(SCREEN_WIDTH * 2 + SCREEN_HEIGHT * 2))));
@@ -618,6 +2981,21 @@ private:
 		}
 	}
 
+	void SpawnWorldAsteroidField()
+	{
+		// Scatter the field over the whole world but not on screen, sectors wake what is close
+		for (int i = 0; i < m_WorldAsteroids; i++)
+		{
+			Vec2 spawn;
+			do
+			{
+				spawn = Vec2(float(rand()) / float(RAND_MAX) * (m_WorldSize.x - 1), float(rand()) / float(RAND_MAX) * (m_WorldSize.y - 1));
+			} while (fabsf(WrapDelta(spawn - m_Player.GetPosition(), m_WorldSize).x) < SCREEN_WIDTH / 2 && fabsf(WrapDelta(spawn - m_Player.GetPosition(), m_WorldSize).y) < SCREEN_HEIGHT / 2);
+
+			m_Sectors.Insert(CreateAsteroid(spawn, 20), m_SimTime);
+		}
+	}
+
 	Flying_Object CreateAsteroid(const Vec2& Spawn, int Size)
 	{
 		// Generate random parameters for asteroid
@@ -625,41 +3003,490 @@ private:
 		float randSpeedAmp = 1.0f + (float(rand()) / float(RAND_MAX / (1.0f - 75.0f)));
 
 		Vec2 Speed = Vec2(sinf(randRadAngle), cosf(randRadAngle)) * randSpeedAmp;
-		Flying_Object Rock = Flying_Object(Spawn, Speed, Size, randRadAngle, m_Asteroid_Model);
+		Flying_Object Rock = Flying_Object(Spawn, Speed, Size, randRadAngle, MODEL_ASTEROID);
 		return Rock;
 	}
 };
 
+// Plays the game from its state, for unattended runs: turns to the nearest asteroid and shoots
+// once lined up, and drifts slowly while nothing is close. When the nearest asteroid is on course to
+// hit the ship soon, it thrusts whenever the nose points away from where the asteroid will pass,
+// and afterwards brakes off the speed the dodge left, since nothing else slows the ship down.
+class Autopilot
+{
+public:
+	uint32_t Decide(const GameManager& Game) const
+	{
+		uint32_t keys = 0;
+
+		Vec2 delta;
+		const Flying_Object* asteroid = Game.FindNearestAsteroid(delta);
+		if (!asteroid)
+			return keys;
+
+		const Shuttle& player = Game.GetPlayer();
+		float aim = TurnTo(atan2f(delta.x, -delta.y), player.GetAngle());
+		if (fabsf(aim) < 8.0f)
+			keys |= 1u << KEY_FIRE;
+
+		// Closest approach if neither changes course, miss is where the asteroid is then
+		Vec2 closing = asteroid->GetSpeed() - player.GetSpeed();
+		float speed2 = closing.x * closing.x + closing.y * closing.y;
+		float when = speed2 > 0.0f ? -(delta.x * closing.x + delta.y * closing.y) / speed2 : -1.0f;
+		Vec2 miss = delta + closing * when;
+		float reach = (asteroid->GetSize() + player.GetSize()) * 1.5f + 15.0f;
+
+		if (when > 0.0f && when < 1.5f && miss.Length() < reach)
+		{
+			// Turning is slow, so keep shooting at it and only thrust when the nose already helps
+			float angle = player.GetAngle() * float(PI) / 180.0f;
+			Vec2 nose = Vec2(sinf(angle), -cosf(angle));
+			float distance = miss.Length();
+			if (distance > 1.0f && (nose.x * miss.x + nose.y * miss.y) < -0.5f * distance)
+				keys |= 1u << KEY_THRUST;
+			return keys | Steer(aim);
+		}
+
+		Vec2 speed = player.GetSpeed();
+		if (speed.Length() > 50.0f)
+		{
+			float back = TurnTo(atan2f(-speed.x, speed.y), player.GetAngle());
+			if (fabsf(back) < 30.0f)
+				keys |= 1u << KEY_THRUST;
+			return keys | Steer(back);
+		}
+
+		keys |= Steer(aim);
+		if (delta.Length() > 200.0f && speed.Length() < 40.0f)
+			keys |= 1u << KEY_THRUST;
+
+		return keys;
+	}
+
+private:
+	// Signed degrees from Angle to Bearing (radians, 0 is up), in [-180, 180)
+	static float TurnTo(float Bearing, float Angle)
+	{
+		float turn = fmodf(Bearing * float(180 / PI) - Angle, 360.0f);
+		if (turn < -180.0f) turn += 360.0f;
+		if (turn >= 180.0f) turn -= 360.0f;
+		return turn;
+	}
+
+	static uint32_t Steer(float Turn)
+	{
+		if (Turn < -4.0f)
+			return 1u << KEY_LEFT;
+		if (Turn > 4.0f)
+			return 1u << KEY_RIGHT;
+		return 0;
+	}
+};
+
+// Resident memory of the process in bytes, 0 where it cannot be queried
+static size_t ResidentMemory()
+{
+#if defined(_WIN32)
+	ProcessMemoryCounters counters;
+	counters.cb = sizeof(counters);
+	if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#elif defined(__linux__)
+	FILE* file = OpenFile("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+	unsigned long pages = 0;
+	unsigned long resident = 0;
+	int read = fscanf(file, "%lu %lu", &pages, &resident);
+	fclose(file);
+	return read == 2 ? size_t(resident) * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#else
+	return 0;
+#endif
+}
+
+// Long unattended run: one CSV row per simulated minute with frame time percentiles,
+// entity counts and resident memory, and a verdict on whether any of them keeps growing
+class SoakMonitor
+{
+private:
+	struct Minute
+	{
+		float FrameP50;
+		float FrameP99;
+		float Asteroids;
+		float Bullets;
+		float Particles;
+		float ResidentMB;
+	};
+
+	// Regressors of a trend fit: the minute, then the load, objects apart from particles since a
+	// particle costs far less than an outline
+	enum Term { TERM_MINUTE, TERM_OBJECTS, TERM_PARTICLES, TERM_COUNT };
+
+	FILE* m_Csv;
+	double m_SimTime;
+	double m_FrameStart;
+	std::vector<float> m_FrameTimes; // ms, current minute
+	double m_Asteroids;
+	double m_Bullets;
+	double m_Particles;
+	std::vector<Minute> m_Minutes;
+
+public:
+	SoakMonitor() : m_Csv(nullptr), m_SimTime(0.0), m_FrameStart(0.0), m_Asteroids(0.0), m_Bullets(0.0), m_Particles(0.0) {}
+
+	~SoakMonitor()
+	{
+		if (m_Csv)
+			fclose(m_Csv);
+	}
+
+	bool Start(const std::string& Path)
+	{
+		m_Csv = OpenFile(Path.c_str(), "w");
+		if (!m_Csv)
+			return false;
+		fprintf(m_Csv, "minute,frames,frame_p50_ms,frame_p99_ms,asteroids,bullets,particles,resident_mb\n");
+		fflush(m_Csv);
+		return true;
+	}
+
+	double GetSimTime() const
+	{
+		return m_SimTime;
+	}
+
+	void BeginFrame()
+	{
+		m_FrameStart = NowSeconds();
+	}
+
+	void EndFrame(double SimDt, size_t Asteroids, size_t Bullets, size_t Particles)
+	{
+		m_FrameTimes.push_back(float((NowSeconds() - m_FrameStart) * 1000.0));
+		m_Asteroids += Asteroids;
+		m_Bullets += Bullets;
+		m_Particles += Particles;
+
+		int minute = int(m_SimTime / 60.0);
+		m_SimTime += SimDt;
+		if (int(m_SimTime / 60.0) != minute)
+			CloseMinute();
+	}
+
+	// Fit a trend through each series, skipping the warm-up minute, and fail on growth over Tolerance
+	// of the mean or an absolute floor, whichever is larger. Short headless frames and small entity
+	// counts would otherwise turn noise and game phases into huge relative growth. Floors are given
+	// for the default tolerance of 0.25 and shrink with it. Frame times are corrected for the number
+	// of entities first, since busy and quiet phases are not drift; their floor is 1% of FrameBudgetMs,
+	// or Tolerance of the first judged minute when uncapped (FrameBudgetMs 0). Counts may swing by a
+	// wave of asteroids. Memory is judged on growth alone against 0.1 MB per minute, next to the whole
+	// process a leak is too small for a relative limit.
+	bool Evaluate(FILE* Out, float Tolerance, float FrameBudgetMs) const
+	{
+		if (m_Minutes.size() < 4)
+		{
+			fprintf(Out, "soak: %u minutes recorded, too short to judge trends\n", unsigned(m_Minutes.size()));
+			return true;
+		}
+
+		float scale = Tolerance / 0.25f;
+		float span = float(m_Minutes.size() - 2);
+		const Minute& first = m_Minutes[1];
+
+		bool pass = true;
+		pass &= CheckTrend(Out, "frame p50 ms", &Minute::FrameP50, true, Tolerance, FrameBudgetMs > 0.0f ? FrameBudgetMs * 0.01f * scale : first.FrameP50 * Tolerance);
+		pass &= CheckTrend(Out, "frame p99 ms", &Minute::FrameP99, true, Tolerance, FrameBudgetMs > 0.0f ? FrameBudgetMs * 0.01f * scale : first.FrameP99 * Tolerance);
+		pass &= CheckTrend(Out, "asteroids", &Minute::Asteroids, false, Tolerance, 20.0f * scale);
+		pass &= CheckTrend(Out, "bullets", &Minute::Bullets, false, Tolerance, 20.0f * scale);
+		pass &= CheckTrend(Out, "resident MB", &Minute::ResidentMB, false, 0.0f, 0.1f * scale * span);
+		fprintf(Out, "soak: %s after %u minutes\n", pass ? "PASS" : "FAIL", unsigned(m_Minutes.size()));
+		return pass;
+	}
+
+private:
+	void CloseMinute()
+	{
+		size_t frames = m_FrameTimes.size();
+		Minute row;
+		row.FrameP50 = LatencyStats::Percentile(m_FrameTimes, 0.5f);
+		row.FrameP99 = LatencyStats::Percentile(m_FrameTimes, 0.99f);
+		row.Asteroids = float(m_Asteroids / frames);
+		row.Bullets = float(m_Bullets / frames);
+		row.Particles = float(m_Particles / frames);
+		row.ResidentMB = float(ResidentMemory() / (1024.0 * 1024.0));
+		m_Minutes.push_back(row);
+
+		if (m_Csv)
+		{
+			fprintf(m_Csv, "%u,%u,%.4f,%.4f,%.2f,%.2f,%.1f,%.2f\n", unsigned(m_Minutes.size()), unsigned(frames), row.FrameP50, row.FrameP99, row.Asteroids, row.Bullets, row.Particles, row.ResidentMB);
+			fflush(m_Csv);
+		}
+
+		m_FrameTimes.clear();
+		m_Asteroids = 0.0;
+		m_Bullets = 0.0;
+		m_Particles = 0.0;
+	}
+
+	// Growth over the run fails past Tolerance of the mean or Floor, whichever is larger, unless it is
+	// within three standard errors of none. Sub-millisecond frame times jitter by half their value from
+	// minute to minute with whatever else the machine runs, a real drift stands out of that.
+	bool CheckTrend(FILE* Out, const char* Name, float Minute::*Field, bool ByLoad, float Tolerance, float Floor) const
+	{
+		double mean, error;
+		double slope = FitTrend(Field, ByLoad, mean, error);
+
+		size_t n = m_Minutes.size() - 1;
+		double growth = slope * (n - 1);
+		double noise = error * (n - 1) * 3.0;
+		double allowed = std::max(mean * Tolerance, double(Floor));
+		bool pass = growth <= allowed || growth <= noise;
+		fprintf(Out, "soak: %-16s mean %9.3f, %sgrowth over run %+9.3f, allowed %8.3f, noise %8.3f %s\n", Name, mean, ByLoad ? "load adjusted " : "", growth, allowed, noise, pass ? "ok" : "TRENDS UP");
+		return pass;
+	}
+
+	// Least squares slope per minute of Field, minutes after the first, and its standard error. With
+	// ByLoad the entity counts are further regressors, so only the part of the change they do not
+	// explain counts as a trend.
+	double FitTrend(float Minute::*Field, bool ByLoad, double& Mean, double& Error) const
+	{
+		// Cross products of the centered regressors and Field, which is kept in the last row and column
+		const int Y = TERM_COUNT;
+		size_t n = m_Minutes.size() - 1;
+		double mean[TERM_COUNT + 1] = {};
+		for (size_t i = 0; i < n; i++)
+		{
+			double values[TERM_COUNT + 1];
+			GetTerms(i, Field, values);
+			for (int t = 0; t <= Y; t++)
+				mean[t] += values[t] / n;
+		}
+		Mean = mean[Y];
+
+		double products[TERM_COUNT + 1][TERM_COUNT + 1] = {};
+		for (size_t i = 0; i < n; i++)
+		{
+			double values[TERM_COUNT + 1];
+			GetTerms(i, Field, values);
+			for (int t = 0; t <= Y; t++)
+				for (int u = 0; u <= Y; u++)
+					products[t][u] += (values[t] - mean[t]) * (values[u] - mean[u]);
+		}
+
+		// Sweep the regressors in one by one. A load that does not vary, or varies in lockstep with
+		// time or the other load, has nothing left of its diagonal and is left out.
+		double diagonal[TERM_COUNT];
+		for (int t = 0; t < TERM_COUNT; t++)
+			diagonal[t] = products[t][t];
+
+		// Short runs take fewer loads, so a couple of degrees of freedom are left to measure noise with
+		int terms = ByLoad ? std::max(1, std::min(int(TERM_COUNT), int(n) - 3)) : 1;
+		int used = 0;
+		for (int t = 0; t < terms; t++)
+		{
+			if (products[t][t] <= 1e-9 * diagonal[t])
+				continue;
+			Sweep(products, t);
+			used++;
+		}
+
+		// Swept, the last column holds the coefficients, the corner the residual sum of squares and
+		// the diagonal the inverse of the normal matrix. The mean is one more fitted parameter.
+		int freedom = int(n) - used - 1;
+		double variance = freedom > 0 ? std::max(products[Y][Y], 0.0) / freedom : 0.0;
+		Error = sqrt(variance * products[TERM_MINUTE][TERM_MINUTE]);
+		return products[TERM_MINUTE][Y];
+	}
+
+	// Regressors and then Field of a judged minute, Index counts from the first after the warm-up
+	void GetTerms(size_t Index, float Minute::*Field, double* Values) const
+	{
+		const Minute& row = m_Minutes[Index + 1];
+		Values[TERM_MINUTE] = double(Index);
+		Values[TERM_OBJECTS] = row.Asteroids + row.Bullets;
+		Values[TERM_PARTICLES] = row.Particles;
+		Values[TERM_COUNT] = row.*Field;
+	}
+
+	// Sweep operator on symmetric cross products: regresses every other row on Term
+	static void Sweep(double (&Products)[TERM_COUNT + 1][TERM_COUNT + 1], int Term)
+	{
+		double pivot = Products[Term][Term];
+		for (int u = 0; u <= TERM_COUNT; u++)
+			Products[Term][u] /= pivot;
+
+		for (int t = 0; t <= TERM_COUNT; t++)
+		{
+			if (t == Term)
+				continue;
+			double factor = Products[t][Term];
+			for (int u = 0; u <= TERM_COUNT; u++)
+				Products[t][u] -= factor * Products[Term][u];
+			Products[t][Term] = -factor / pivot;
+		}
+		Products[Term][Term] = 1.0 / pivot;
+	}
+};
+
+// Rasterize a saved frame again and again with nothing else running, the wrap mode follows ASTEROIDS_WORLD
+static bool ReplayCommands(const GameConfig& Config, FILE* Out)
+{
+	DrawCommandBuffer commands;
+	if (!commands.LoadFromFile(Config.Replay.c_str()))
+	{
+		fprintf(Out, "could not load draw commands from '%s'\n", Config.Replay.c_str());
+		return false;
+	}
+
+	std::vector<uint32_t> board(SCREEN_WIDTH * SCREEN_HEIGHT);
+	Gamefield field(board.data());
+	field.SetWrap(Config.WorldScale <= 1);
+
+	std::vector<float> times;
+	for (int run = 0; run < Config.ReplayRuns; run++)
+	{
+		std::fill(board.begin(), board.end(), 0u);
+		double start = NowSeconds();
+		field.Execute(commands, LAYER_PLAYER, LAYER_HUD);
+		times.push_back(float((NowSeconds() - start) * 1000.0));
+	}
+
+	fprintf(Out, "replay: %u commands, %d runs, p50 %.4f ms, p99 %.4f ms, max %.4f ms\n", unsigned(commands.Size()), Config.ReplayRuns,
+		LatencyStats::Percentile(times, 0.5f), LatencyStats::Percentile(times, 0.99f), LatencyStats::Percentile(times, 1.0f));
+	return true;
+}
+
 GameManager* gm;
+GameConfig config;
+InputState input;
+LatencyStats latency;
+FramePacer pacer;
+TurboStats turbo;
+FrameExport frames;
+Autopilot autopilot;
+SoakMonitor soak;
+uint64_t frame_index = 0;
+bool replay_ok = true;
+double frame_sim_time = 0.0;
 
 // initialize game data in this function
 void initialize()
 {
-	gm = new GameManager(*buffer);
+	config = GameConfig::FromEnvironment();
+	pacer.SetTargetRate(config.TargetFps);
+
+	if (!config.SharedFrames.empty() && !frames.Open(config.SharedFrames, config.SharedFrameSlots))
+		fprintf(stderr, "could not export frames to shared memory '%s'\n", config.SharedFrames.c_str());
+
+	if (config.SoakMinutes > 0.0f && !soak.Start(config.SoakCsv))
+		fprintf(stderr, "could not write soak statistics to '%s'\n", config.SoakCsv.c_str());
+
+	gm = new GameManager(*buffer, config);
+
+	// A replay is a benchmark of the rasterizer alone, the game quits right after it
+	if (!config.Replay.empty())
+	{
+		replay_ok = ReplayCommands(config, stderr);
+		schedule_quit_game();
+	}
 }
 
 // this function is called to update game data,
 // dt - time elapsed since the previous update (in seconds)
 void act(float dt)
 {
-	if (is_key_pressed(VK_ESCAPE))
+	// Wait here rather than after draw() so input is sampled as late as possible
+	pacer.Wait();
+	soak.BeginFrame();
+
+	// Reproducible runs step a fixed time instead of the wall clock
+	if (config.FixedDt > 0.0f)
+		dt = config.FixedDt;
+
+	// All keys are read together once per tick
+	InputSnapshot keys = input.Sample();
+
+	if (keys.IsDown(KEY_QUIT))
 		schedule_quit_game();
+
+	// Quit still comes from the keyboard, the rest from the autopilot
+	if (config.Autopilot)
+		keys.Keys = (keys.Keys & (1u << KEY_QUIT)) | autopilot.Decide(*gm);
 	
-	gm->UpdateGame(dt);
+	// Turbo runs several normal ticks per frame, each sees the same input and dt
+	for (int tick = 0; tick < config.TicksPerFrame; tick++)
+		gm->UpdateGame(keys, dt);
+	frame_sim_time = double(dt) * config.TicksPerFrame;
+
+	if (config.IsTurbo())
+		turbo.OnFrame(config.TicksPerFrame, dt, stderr);
+}
+
+// Draw the game into the window buffer or the next shared frame
+static void render_frame()
+{
+	turbo.OnDraw();
+
+	// Exported frames are composited in place in shared memory, the window buffer is then left alone
+	uint32_t* target = frames.IsOpen() ? frames.BeginFrame() : *buffer;
+
+	gm->SetRenderTarget(target);
+	gm->DrawGame();
+
+	if (frames.IsOpen())
+		frames.EndFrame();
+
+	// The frame is in the backbuffer now. The engine blits it to the window after draw() returns,
+	// so the latency figures leave the blit out.
+	latency.OnPresent(input, NowSeconds());
 }
 
 // fill buffer in this function
 // uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH] - is an array of 32-bit colors (8 bits per R, G, B)
 void draw()
 {
-	// clear backbuffer
-	memset(buffer, 0, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
-	gm->DrawGame();
+	// Rendering can be throttled or switched off, the last drawn frame stays in the buffer
+	bool skip = config.RenderEvery == 0 || frame_index++ % config.RenderEvery != 0;
+	if (!skip)
+		render_frame();
+
+	if (config.SoakMinutes > 0.0f)
+	{
+		soak.EndFrame(frame_sim_time, gm->GetAsteroidCount(), gm->GetBulletCount(), gm->GetParticleCount());
+		if (soak.GetSimTime() >= config.SoakMinutes * 60.0)
+			schedule_quit_game();
+	}
 }
 
+
 // free game data in this function
 void finalize()
 {
+	FILE* report = config.LatencyLog.empty() ? nullptr : OpenFile(config.LatencyLog.c_str(), "w");
+	if (!config.LatencyLog.empty() && !report)
+		fprintf(stderr, "could not write latency report to '%s'\n", config.LatencyLog.c_str());
+	latency.Report(report ? report : stderr);
+	pacer.Report(report ? report : stderr);
+	if (report)
+		fclose(report);
+
+	if (config.IsTurbo())
+		turbo.Report(stderr);
+	frames.Close();
+
+	if (!config.SaveFrame.empty() && !gm->SaveLastFrame(config.SaveFrame.c_str()))
+		fprintf(stderr, "could not save draw commands to '%s'\n", config.SaveFrame.c_str());
 	delete gm;
+
+	if (!replay_ok)
+		exit(EXIT_FAILURE);
+
+	// Uncapped runs have no budget, their frame times are judged against their own start
+	float budget = config.TargetFps > 0.0f ? 1000.0f / config.TargetFps : 0.0f;
+	if (config.SoakMinutes > 0.0f && !soak.Evaluate(stderr, config.SoakTolerance, budget))
+		exit(EXIT_FAILURE);
 }
 
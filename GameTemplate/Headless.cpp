@@ -0,0 +1,119 @@
+//
+//  Windowless implementation of Engine.h, a drop-in replacement for Engine.cpp.
+//  Nothing is displayed and no key is ever pressed, which is what turbo runs,
+//  soak tests and benchmarks need. Builds on any platform with a C++14 compiler:
+//
+//    g++ -O2 -std=c++14 Game.cpp Headless.cpp -o asteroids_headless -pthread
+//
+//  Usage: asteroids_headless [--seconds S] [--frames N]
+//  Game.cpp switches (ASTEROIDS_FPS, ASTEROIDS_TURBO, ...) apply as usual.
+//  --seconds 0 runs until the game quits, e.g. a reproducible soak test:
+//
+//    ASTEROIDS_SOAK_MINUTES=10 ASTEROIDS_AUTOPILOT=1 ASTEROIDS_SEED=1
+//    ASTEROIDS_FIXED_DT=0.0166667 ASTEROIDS_FPS=0 ./asteroids_headless --seconds 0
+//
+//  Rendering alone can be benchmarked on a saved frame:
+//
+//    ASTEROIDS_SAVE_FRAME=frame.adcb ./asteroids_headless --seconds 5
+//    ASTEROIDS_REPLAY=frame.adcb ASTEROIDS_REPLAY_RUNS=5000 ./asteroids_headless
+//
+
+#include "Engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH] = { 0 };
+
+static bool quited = false;
+
+bool is_window_active()
+{
+  return false;
+}
+
+void clear_buffer()
+{
+  memset(buffer, 0, sizeof(buffer));
+}
+
+bool is_key_pressed(int button_vk_code)
+{
+  (void)button_vk_code;
+  return false;
+}
+
+bool is_mouse_button_pressed(int button)
+{
+  (void)button;
+  return false;
+}
+
+int get_cursor_x()
+{
+  return 0;
+}
+
+int get_cursor_y()
+{
+  return 0;
+}
+
+void schedule_quit_game()
+{
+  quited = true;
+}
+
+static double now_seconds()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv)
+{
+  double run_seconds = 10.0;
+  long long run_frames = -1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+      run_seconds = atof(argv[++i]);
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      run_frames = atoll(argv[++i]);
+    else
+    {
+      fprintf(stderr, "usage: %s [--seconds S] [--frames N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  initialize();
+
+  // Same dt rules as the windowed loop in Engine.cpp
+  double start = now_seconds();
+  double ref_time = start;
+  for (long long frame = 0; !quited; frame++)
+  {
+    if (run_frames >= 0 && frame >= run_frames)
+      break;
+    if (run_frames < 0 && run_seconds > 0.0 && ref_time - start >= run_seconds)
+      break;
+
+    double t = now_seconds();
+    float dt = float(t - ref_time);
+    if (dt > 0.1f)
+      dt = 0.1f;
+
+    act(dt);
+
+    if (!quited)
+      draw();
+
+    ref_time = t;
+  }
+
+  finalize();
+
+  return 0;
+}